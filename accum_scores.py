@@ -8,6 +8,8 @@
 
 import os
 import sys
+import gzip
+import json
 import torch
 import math
 
@@ -15,6 +17,34 @@ import math
 A little utility script to accumulate average scores from logs across multiple runs
 """
 
+def read_game_records(filename):
+    """
+    Yields (score, bomb) for each game in a file written by eval_bot.py --record.
+    See GameRecord::appendTo in csrc/GameRecord.h for the format.
+    """
+    data = gzip.open(filename, 'rb').read()
+    pos = 0
+    while pos < len(data):
+        assert data[pos:pos + 2] == b'H\x01', "not a game record file: " + filename
+        deck_size = data[pos + 8]
+        pos += 9 + deck_size
+        num_moves = data[pos] | (data[pos + 1] << 8)
+        pos += 2 + num_moves
+        score, mulligans_used = data[pos], data[pos + 1]
+        pos += 2
+        yield score, mulligans_used == 3
+
+
+def read_game_metrics(filename):
+    """
+    Yields (score, bomb) for each game in a file written by eval_bot.py --metrics.
+    """
+    for line in open(filename, 'r'):
+        entry = json.loads(line)
+        if entry['type'] == 'game':
+            yield entry['score'], entry['bomb'] != 0
+
+
 def calc_scores(filenames):
     scores = []
     num_moves = []
@@ -27,6 +57,15 @@ def calc_scores(filenames):
     my_expected_delta_win = 0
 
     for filename in filenames:
+        if filename.endswith('.hrec.gz') or filename.endswith('.jsonl'):
+            games = read_game_records(filename) if filename.endswith('.hrec.gz') else read_game_metrics(filename)
+            for score, bomb in games:
+                scores.append(score)
+                scores_bomb0.append(0 if bomb else score)
+                num_bombs += 1 if bomb else 0
+                expected_delta.append(0)
+                expected_delta_win.append(0)
+            continue
         og, eg = 0, 0
         for line in open(filename, 'r'):
             fields = line.split()
@@ -66,7 +105,7 @@ if __name__ == "__main__":
     for path in paths:
         if os.path.isdir(path):
             for filename in os.listdir(path):
-                if filename.startswith('task') and filename.endswith('.out'):
+                if (filename.startswith('task') and filename.endswith('.out')) or filename.endswith('.hrec.gz') or filename.endswith('.jsonl'):
                     files.append(path + '/' + filename)
         else:
             files.append(path)
@@ -7,6 +7,7 @@
 #pragma once
 
 #include <iostream>
+#include <sstream>
 #include <vector>
 
 #include <torch/torch.h>
@@ -16,6 +17,7 @@
 using namespace std::chrono;
 
 #include "Batcher.h"
+#include "Log.h"
 
 class AsyncModelWrapper {
  public:
@@ -44,12 +46,15 @@ class AsyncModelWrapper {
       int B = 1000;
       int P = 1000000;
       if (i % B == 0) {
-        if (i % P == 0) std::cerr << "avg time (over " << B << " runs): " << std::endl;
+        if (i % P == 0 && HANABI_LOG_IS_ON(INFO, TorchBot)) {
+          std::ostringstream times;
+          times << "avg time (over " << B << " runs): ";
+          for (auto& kv : timer_) times << std::endl << kv.first << ", " << kv.second / B;
+          HANABI_LOG(INFO, TorchBot) << times.str();
+        }
         for (auto& kv : timer_) {
-          if (i % P == 0) std::cerr << kv.first << ", " << kv.second / B << std::endl;
           timer_[kv.first] = 0;
         }
-        if (i % P == 0) std::cerr << "===================" << std::endl;
       }
 
       auto start = high_resolution_clock::now();
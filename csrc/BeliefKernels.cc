@@ -0,0 +1,171 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+
+#include "BeliefKernels.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define HANABI_HAVE_AVX2_KERNELS 1
+#include <immintrin.h>
+#endif
+
+using namespace Hanabi;
+
+// A packed hand has a card's color in the high nibble of its byte and its
+// value in the low one, and nothing in the bytes past the end of the hand.
+static constexpr uint64_t LOW_NIBBLES = 0x0f0f0f0f0f0f0f0full;
+static constexpr uint64_t HIGH_BITS = 0x8080808080808080ull;
+static constexpr uint64_t SEVENS = 0x7f7f7f7f7f7f7f7full;
+
+// bit i of mask spread to the high bit of byte i
+static uint64_t spreadToHighBits(unsigned mask) {
+  uint64_t spread = 0;
+  for (int i = 0; i < 8; i++) {
+    if (mask & (1u << i)) spread |= (uint64_t) 0x80 << (8 * i);
+  }
+  return spread;
+}
+
+// 0x80 in each byte of x that isn't zero; every byte must be below 0x81,
+// so adding 0x7f to it can't carry into the next
+static inline uint64_t nonzeroBytes(uint64_t x) {
+  return (x + SEVENS) & HIGH_BITS;
+}
+
+// the byte of card in a packed hand
+static uint8_t packedCard(Card card) {
+  Hand hand;
+  hand.push_back(card);
+  return (uint8_t) packHand(hand);
+}
+
+unsigned cardIndicesMask(const CardIndices &indices) {
+  unsigned mask = 0;
+  for (int i = 0; i < 8; i++) {
+    if (indices.contains(i)) mask |= 1u << i;
+  }
+  return mask;
+}
+
+void hintConsistentHandsPortable(const PackedHand *hands, size_t n, bool color, int value,
+                                unsigned touched, unsigned relevant, uint8_t *keep) {
+  const uint64_t target = LOW_NIBBLES & (0x0101010101010101ull * value);
+  const uint64_t untouched = spreadToHighBits(~touched & 0xff);
+  const uint64_t checked = spreadToHighBits(relevant & 0xff);
+  for (size_t i = 0; i < n; i++) {
+    const PackedHand hand = hands[i];
+    const uint64_t field = (color ? hand >> 4 : hand) & LOW_NIBBLES;
+    // a touched card mustn't differ from the hint, and an untouched one must
+    const uint64_t differs = nonzeroBytes(field ^ target);
+    keep[i] = ((differs ^ untouched) & checked & nonzeroBytes(hand)) == 0;
+  }
+}
+
+// the same as the scalar update, so that the result doesn't depend on the
+// version of the kernel
+static inline void reweight_(int in_hand, int remaining, float &prob, uint8_t &keep) {
+  if (in_hand > 0) {
+    prob = prob * (remaining - in_hand) / remaining;
+  }
+  keep = in_hand == 0 || prob > 0;
+}
+
+void reweightHandsForRevealedCardPortable(const PackedHand *hands, size_t n, Card card, int remaining,
+                                         unsigned relevant, float *probs, uint8_t *keep) {
+  const uint64_t target = 0x0101010101010101ull * packedCard(card);
+  const uint64_t checked = spreadToHighBits(relevant & 0xff);
+  for (size_t i = 0; i < n; i++) {
+    // a byte past the end of the hand is zero, so it never matches
+    const uint64_t matches = ~nonzeroBytes(hands[i] ^ target) & checked;
+    reweight_(__builtin_popcountll(matches), remaining, probs[i], keep[i]);
+  }
+}
+
+#ifdef HANABI_HAVE_AVX2_KERNELS
+__attribute__((target("avx2")))
+static void hintConsistentHandsAvx2_(const PackedHand *hands, size_t n, bool color, int value,
+                                     unsigned touched, unsigned relevant, uint8_t *keep) {
+  // the same as the portable version, with whole bytes for masks
+  const __m256i low_nibbles = _mm256_set1_epi8(0x0f);
+  const __m256i target = _mm256_set1_epi8((char) value);
+  const __m256i expected = _mm256_set1_epi64x((long long) (spreadToHighBits(touched & 0xff) >> 7) * 0xff);
+  const __m256i checked = _mm256_set1_epi64x((long long) (spreadToHighBits(relevant & 0xff) >> 7) * 0xff);
+  const __m256i zero = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m256i hand = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(hands + i));
+    const __m256i field = _mm256_and_si256(color ? _mm256_srli_epi16(hand, 4) : hand, low_nibbles);
+    const __m256i matches = _mm256_cmpeq_epi8(field, target);
+    const __m256i present = _mm256_andnot_si256(_mm256_cmpeq_epi8(hand, zero), checked);
+    const __m256i wrong = _mm256_and_si256(_mm256_xor_si256(matches, expected), present);
+    const int ok = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(wrong, zero)));
+    keep[i] = ok & 1;
+    keep[i + 1] = (ok >> 1) & 1;
+    keep[i + 2] = (ok >> 2) & 1;
+    keep[i + 3] = (ok >> 3) & 1;
+  }
+  hintConsistentHandsPortable(hands + i, n - i, color, value, touched, relevant, keep + i);
+}
+
+__attribute__((target("avx2")))
+static void reweightHandsForRevealedCardAvx2_(const PackedHand *hands, size_t n, Card card, int remaining,
+                                              unsigned relevant, float *probs, uint8_t *keep) {
+  const __m256i target = _mm256_set1_epi8((char) packedCard(card));
+  // 1 in each relevant byte, so that summing the matching bytes counts them
+  const __m256i checked = _mm256_set1_epi64x((long long) (spreadToHighBits(relevant & 0xff) >> 7));
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i low_dwords = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+  const __m128 remaining_ps = _mm_set1_ps((float) remaining);
+  const __m128 zero_ps = _mm_setzero_ps();
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m256i hand = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(hands + i));
+    const __m256i matches = _mm256_and_si256(_mm256_cmpeq_epi8(hand, target), checked);
+    // the count for each hand, in the low dword of its lane; then the four
+    // of them, as floats
+    const __m256i counts = _mm256_permutevar8x32_epi32(_mm256_sad_epu8(matches, zero), low_dwords);
+    const __m128i in_hand = _mm256_castsi256_si128(counts);
+    const __m128 in_hand_ps = _mm_cvtepi32_ps(in_hand);
+    const __m128 prob = _mm_loadu_ps(probs + i);
+    const __m128 scaled = _mm_div_ps(_mm_mul_ps(prob, _mm_sub_ps(remaining_ps, in_hand_ps)), remaining_ps);
+    const __m128 none = _mm_castsi128_ps(_mm_cmpeq_epi32(in_hand, _mm_setzero_si128()));
+    const __m128 updated = _mm_blendv_ps(scaled, prob, none);
+    _mm_storeu_ps(probs + i, updated);
+    const int ok = _mm_movemask_ps(_mm_or_ps(none, _mm_cmpgt_ps(updated, zero_ps)));
+    keep[i] = ok & 1;
+    keep[i + 1] = (ok >> 1) & 1;
+    keep[i + 2] = (ok >> 2) & 1;
+    keep[i + 3] = (ok >> 3) & 1;
+  }
+  reweightHandsForRevealedCardPortable(hands + i, n - i, card, remaining, relevant, probs + i, keep + i);
+}
+
+static bool haveAvx2_() {
+  static const bool have = (__builtin_cpu_init(), __builtin_cpu_supports("avx2"));
+  return have;
+}
+#endif
+
+void hintConsistentHands(const PackedHand *hands, size_t n, bool color, int value,
+                         unsigned touched, unsigned relevant, uint8_t *keep) {
+#ifdef HANABI_HAVE_AVX2_KERNELS
+  if (haveAvx2_()) {
+    hintConsistentHandsAvx2_(hands, n, color, value, touched, relevant, keep);
+    return;
+  }
+#endif
+  hintConsistentHandsPortable(hands, n, color, value, touched, relevant, keep);
+}
+
+void reweightHandsForRevealedCard(const PackedHand *hands, size_t n, Card card, int remaining,
+                                  unsigned relevant, float *probs, uint8_t *keep) {
+#ifdef HANABI_HAVE_AVX2_KERNELS
+  if (haveAvx2_()) {
+    reweightHandsForRevealedCardAvx2_(hands, n, card, remaining, relevant, probs, keep);
+    return;
+  }
+#endif
+  reweightHandsForRevealedCardPortable(hands, n, card, remaining, relevant, probs, keep);
+}
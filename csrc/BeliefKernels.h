@@ -0,0 +1,43 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+
+#pragma once
+
+#include "BotUtils.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Belief updates over arrays of packed hands, many hands at a time. Each
+// has a portable version, which works on one hand (all its cards at once)
+// per 64-bit word, and on x86 CPUs with AVX2 a version that works on four
+// hands per instruction; the AVX2 one is picked at run time.
+//
+// Positions in a hand are given as bitmasks (bit i is card i); cards past
+// the end of a hand are never looked at, whatever the masks say.
+
+// Sets keep[i] to whether hands[i] is consistent with a hint of this
+// color (or value, if !color): the cards in positions touched have it,
+// and none of the other cards in positions relevant do.
+void hintConsistentHands(const PackedHand *hands, size_t n, bool color, int value,
+                         unsigned touched, unsigned relevant, uint8_t *keep);
+// the portable version, whatever the CPU; for tests
+void hintConsistentHandsPortable(const PackedHand *hands, size_t n, bool color, int value,
+                                 unsigned touched, unsigned relevant, uint8_t *keep);
+
+// Updates the probabilities of hands for the reveal of card, of which
+// remaining copies were unseen before it: a hand with k copies of it in
+// positions relevant was dealt from a deck with k fewer, so its probs[i]
+// is scaled by (remaining - k) / remaining. Sets keep[i] to whether the
+// hand is still possible (has a nonzero probability, or no copies).
+void reweightHandsForRevealedCard(const PackedHand *hands, size_t n, Hanabi::Card card, int remaining,
+                                  unsigned relevant, float *probs, uint8_t *keep);
+// the portable version, whatever the CPU; for tests
+void reweightHandsForRevealedCardPortable(const PackedHand *hands, size_t n, Hanabi::Card card, int remaining,
+                                          unsigned relevant, float *probs, uint8_t *keep);
+
+// the bitmask of the card positions in indices
+unsigned cardIndicesMask(const Hanabi::CardIndices &indices);
@@ -14,6 +14,7 @@ struct BotFactory final : public Hanabi::BotFactory
 {
     Hanabi::Bot *create(int index, int numPlayers, int handSize) const override { return new SpecificBot(index, numPlayers, handSize); }
     void destroy(Hanabi::Bot *bot) const override { delete bot; }
+    void warmUp(int numPlayers, int handSize) const override { SpecificBot::warmUp(numPlayers, handSize); }
 };
 
 #endif /* H_BOT_FACTORY */
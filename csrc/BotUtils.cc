@@ -17,11 +17,15 @@
 #include <chrono>
 #include <ctime>
 #include <thread>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 
 #include "InfoBot.h"
 #include "SmartBot.h"
 
 #include "BotUtils.h"
+#include "Log.h"
 
 using namespace Hanabi;
 using namespace HanabiParams;
@@ -45,13 +49,6 @@ BotVec cloneBotVec(const BotVec &vec, int who) {
 //////////////////////    Helper Functions   ///////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 
-std::string now() {
-  std::time_t now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
-  char timestr[100];
-  std::strftime(timestr, sizeof(timestr), "%Y-%m-%d %H:%M:%S", std::localtime(&now));
-  return std::string(timestr) + "  ";
-}
-
 std::string colorname(Hanabi::Color color)
 {
     switch (color) {
@@ -94,25 +91,36 @@ bool operator!=(const Move& l, const Move& r)
 }
 
 
-std::vector<Move> enumerateLegalMoves(const Server &server) {
-  std::set<Move> moves;
-  for (int i = 0; i < server.sizeOfHandOfPlayer(server.whoAmI()); i++) {
-    moves.insert(Move(PLAY_CARD, i));
-    if (server.discardingIsAllowed()) {
-      moves.insert(Move(DISCARD_CARD, i));
+MoveList enumerateLegalMoves(const Server &server) {
+  // generated directly in sorted order, i.e. by (type, value, to)
+  MoveList moves;
+  const int me = server.whoAmI();
+  const int hand_size = server.sizeOfHandOfPlayer(me);
+  for (int i = 0; i < hand_size; i++) {
+    moves.push_back(Move(PLAY_CARD, i));
+  }
+  if (server.discardingIsAllowed()) {
+    for (int i = 0; i < hand_size; i++) {
+      moves.push_back(Move(DISCARD_CARD, i));
     }
   }
-  for (int p = 0; p < server.numPlayers(); p++) {
-    if (p == server.whoAmI()) continue;
-    Hand partner_hand = server.handOfPlayer(p);
-    for (Card card : partner_hand) {
-      if (server.hintStonesRemaining() > 0) {
-        moves.insert(Move(HINT_COLOR, card.color, p));
-        moves.insert(Move(HINT_VALUE, card.value, p));
+  if (server.hintStonesRemaining() > 0) {
+    for (Color color = RED; color <= BLUE; color++) {
+      for (int p = 0; p < server.numPlayers(); p++) {
+        if (p != me && !server.cardsMatchingHint(p, color).empty()) {
+          moves.push_back(Move(HINT_COLOR, color, p));
+        }
+      }
+    }
+    for (Value value = ONE; value <= VALUE_MAX; value++) {
+      for (int p = 0; p < server.numPlayers(); p++) {
+        if (p != me && !server.cardsMatchingHint(p, value).empty()) {
+          moves.push_back(Move(HINT_VALUE, value, p));
+        }
       }
     }
   }
-  return std::vector<Move>(moves.begin(), moves.end());
+  return moves;
 }
 
 std::string handAsString(const Hand &hand)
@@ -126,47 +134,34 @@ std::string handAsString(const Hand &hand)
 }
 
 
-void addToDeck(const std::vector<Card> &cards, DeckComposition &deck) {
+template<class Cards>
+static void addToDeck_(const Cards &cards, DeckComposition &deck) {
   for (auto &card : cards) {
     deck[card]++;
   }
 }
-void removeFromDeck(const std::vector<Card> &cards, DeckComposition &deck) {
+template<class Cards>
+static void removeFromDeck_(const Cards &cards, DeckComposition &deck) {
   for (auto &card : cards) {
     deck[card]--;
     if (deck[card] < 0) {
-      std::cerr << "Invalid removeFromDeck: " << handAsString(cards) << std::endl;
+      HANABI_LOG(ERROR, Bots) << "Invalid removeFromDeck: " << card.toString();
       assert(false);
     }
   }
 }
+void addToDeck(const std::vector<Card> &cards, DeckComposition &deck) { addToDeck_(cards, deck); }
+void addToDeck(const Hand &cards, DeckComposition &deck) { addToDeck_(cards, deck); }
+void removeFromDeck(const std::vector<Card> &cards, DeckComposition &deck) { removeFromDeck_(cards, deck); }
+void removeFromDeck(const Hand &cards, DeckComposition &deck) { removeFromDeck_(cards, deck); }
 
 DeckComposition getCurrentDeckComposition(const Server &server, int who) {
+  // the server keeps these counts up to date as cards move
+  const CardCounts &unseen = server.unseenCards(who);
   DeckComposition deck;
-  for (Color color = (Color) 0; color < NUMCOLORS; ++color) {
-    for (int value = ONE; value <= VALUE_MAX; ++ value) {
-      Card c(color, value);
-      deck[c] = c.count();
-    }
-  }
-
-  // calculate what's left in the deck
-  removeFromDeck(server.discards(), deck);
-  for(int player = 0; player < server.numPlayers(); player++){
-    if (who == -1 || player == who) continue; // who == -1 means public
-    removeFromDeck(server.handOfPlayer(player), deck);
-  }
-  std::vector<Card> pile_cards;
-  for(Color color = RED; color < NUMCOLORS; color++) {
-    auto p = server.pileOf(color);
-    for(Value value = ONE; value <= VALUE_MAX; value++) {
-      if (p.contains((int) value)) {
-        pile_cards.push_back(Card(color, value));
-      }
-    }
+  for (int i = 0; i < DeckComposition::NUMCARDS; i++) {
+    deck.counts[i] = unseen[i];
   }
-  removeFromDeck(pile_cards, deck);
-
   return deck;
 }
 
@@ -208,26 +203,6 @@ int moveToIndex(Move move, const Server &server) {
   assert(false);
 }
 
-int cardToIndex(Card card) {
-  return ((int) card.color) * 5 + ((int) card.value - ONE); // card value starts at one
-}
-
-Card indexToCard(int index) {
-  return Card((Color) (index / 5), index % 5 + ONE);
-}
-
-BoxedHand::BoxedHand(const Hand &hand) {
-  static std::map<Hand, std::unique_ptr<Hand>> box;
-  auto iter = box.find(hand);
-  if (iter == box.end()) {
-    pHand = new Hand(hand);
-    box.emplace(hand, pHand); // owned by box!
-  } else {
-    pHand = iter->second.get();
-  }
-}
-
-
 ////////////////////////////////////////////////////////////////////////////////
 //////////////////////   FactorizedBeliefs   ///////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
@@ -292,12 +267,12 @@ void FactorizedBeliefs::updateFromRevealedCard(Card played_card, const DeckCompo
 
 // update V0 factorized beliefs
   int card_id = cardToIndex(played_card);
-  int remaining = deck.at(played_card); // this is what was remaining *before* the draw
+  int remaining = deck[played_card]; // this is what was remaining *before* the draw
 
   // for (int i = 0; i < server.sizeOfHandOfPlayer(p_); i++) {
   for (int i = 0; i < handSize; i++) {
     if (!(counts[i].get(card_id) == remaining + 1 || counts[i].get(card_id) == 0)) {
-      std::cerr << "handSize " << handSize << " i " << i << " card_id " << card_id << " remaining+1 " << (remaining + 1) << " count " << (int) counts[i].get(card_id) << std::endl;
+      HANABI_LOG(ERROR, Bots) << "handSize " << handSize << " i " << i << " card_id " << card_id << " remaining+1 " << (remaining + 1) << " count " << (int) counts[i].get(card_id);
       assert(0);
     }
     counts[i].set(card_id, counts[i].get(card_id) == 0 ? 0 : remaining);
@@ -324,10 +299,7 @@ void FactorizedBeliefs::updateFromDraw(const DeckComposition &deck, int card_ind
   if (handSize == server.handSize()) {
     // draw the new card
     for (int j = 0; j < 25; j++) {
-      counts[handSize - 1].set(j, 0);
-    }
-    for (const auto &kv : deck) {
-      counts[handSize - 1].set(cardToIndex(kv.first), kv.second);
+      counts[handSize - 1].set(j, deck.counts[j]);
     }
 
     // we know nothing about this new card
@@ -376,15 +348,18 @@ std::array<std::array<float, 25>, 5> FactorizedBeliefs::get() const {
 }
 
 void FactorizedBeliefs::log() {
+  if (!HANABI_LOG_IS_ON(INFO, Bots)) return;
   auto beliefs = get();
-  std::cerr << "V0 beliefs (player " << p_ << "): \n";
+  std::ostringstream out;
+  out << "V0 beliefs (player " << p_ << "): \n";
   for (int i = 0; i < handSize; i++) {
     for (int j = 0; j < 25; j++) {
-      if (j % 5 == 0) std::cerr << std::endl << colorname(Color(j / 5))[0] << ": ";
-      std::cerr << beliefs[i][j] << " ";
+      if (j % 5 == 0) out << std::endl << colorname(Color(j / 5))[0] << ": ";
+      out << beliefs[i][j] << " ";
     }
-    std::cerr << std::endl << std::endl;
+    out << std::endl << std::endl;
   }
+  HANABI_LOG(INFO, Bots) << out.str();
  }
 
 
@@ -397,7 +372,7 @@ void FactorizedBeliefs::log() {
      , mock_(false)
      , last_move_()
  {
-   numPlayers_ = numPlayers;
+   state_.numPlayers = numPlayers;
  }
 
  SimulServer::SimulServer(const Server &server)
@@ -405,7 +380,6 @@ void FactorizedBeliefs::log() {
       , mock_(false)
       , last_move_()
   {
-    numPlayers_ = server.numPlayers();
     sync(server);
   }
 
@@ -417,17 +391,24 @@ void FactorizedBeliefs::log() {
  }
 
  void SimulServer::incrementActivePlayer() {
-   activePlayer_ = (activePlayer_ + 1) % numPlayers_;
-   assert(0 <= finalCountdown_ && finalCountdown_ <= numPlayers_);
-   if (deck_.empty()) finalCountdown_ += 1;
+   advanceTurn_();
+ }
+
+ void SimulServer::setHand(int index, const Hand &hand) {
+   for (const Card &card : state_.hands[index]) cardLeftHand_(index, card);
+   state_.hands[index] = hand;
+   state_.handIds[index].resize(hand.size(), -1);  // the same slots, if not the same cards
+   for (const Card &card : state_.hands[index]) cardEnteredHand_(index, card);
+   updateHintMasks_(index);
  }
 
- void SimulServer::setHand(int index, std::vector<Card> hand) {
-   hands_[index] = hand;
+ void SimulServer::setDeck(const DeckArray &deck) {
+   state_.deck = deck;
  }
 
- void SimulServer::setDeck(const std::vector<Card> &deck) {
-   deck_ = deck;
+ void SimulServer::deal(unsigned int seed) {
+   srand(seed);
+   deal_(std::vector<Card>());
  }
 
  void SimulServer::setObservingPlayer(int observingPlayer) {
@@ -435,46 +416,16 @@ void FactorizedBeliefs::log() {
  }
 
  void SimulServer::sync(const Server &s) {
-   observingPlayer_ = s.whoAmI();
-   activePlayer_ = s.activePlayer();
+   // a flat copy of the game state, with my hand and the deck
+   // filled with junk
+   forkFrom_(s);
    movesFromActivePlayer_ = 0;
-   try {
-     activeCard_ = s.activeCard();
-     activeCardIsObservable_ = true;
-   } catch (ServerError e) {
-     activeCard_ = Card(INVALID_COLOR, 1);
-     activeCardIsObservable_ = false;
-   }
-   finalCountdown_ = s.finalCountdown();
-
-   for (int i = 0; i < NUMCOLORS; i++) {
-     piles_[i] = s.pileOf((Color) i);
-   }
-   discards_ = s.discards();
-   hintStonesRemaining_ = s.hintStonesRemaining();
-   mulligansRemaining_ = s.mulligansRemaining();
-
-   hands_.clear();
-   for (int player = 0; player < s.numPlayers(); player++) {
-     if (player == s.whoAmI()) {
-       // fill my hand with bogus cards
-       hands_.push_back(Hand(s.sizeOfHandOfPlayer(player), Card(INVALID_COLOR, 1)));
-     } else {
-       hands_.push_back(s.handOfPlayer(player));
-     }
-   }
-
-   // make sure the deck is the right size, but fill with junk
-   deck_.clear();
-   for (int i = 0; i < s.cardsRemainingInDeck(); i++) {
-     deck_.push_back(Card(INVALID_COLOR, 1));
-   }
  }
 
  Move SimulServer::simulatePlayerMove(int index, Bot *bot) {
    mock_ = true;
    last_move_ = Move();
-   activePlayer_ = observingPlayer_ = index;
+   state_.activePlayer = observingPlayer_ = index;
    bot->pleaseMakeMove(*this);
    assert(last_move_.type != INVALID_MOVE);
    Move ret = last_move_;
@@ -516,17 +467,15 @@ void FactorizedBeliefs::log() {
    if (update_me) {
      f(players_[me], *this);
    }
-   std::cerr << now() << "applyToAll begin : " << hand_distribution.size() << " hands." << std::endl;
-   auto hand_dist_keys = copyKeys(hand_distribution);
+   HANABI_LOG(DEBUG, Bots) << "applyToAll begin : " << hand_distribution.size() << " hands.";
    std::vector<boost::fibers::future<void>> futures;
    for (int t = 0; t < NUM_THREADS; t++) {
      futures.push_back(getThreadPool().enqueue([&, t]() {
        auto simulserver = std::make_shared<SimulServer>(*this);
        auto fp = std::make_shared<ObservationFunc>(f);
-       for (int i = t; i < hand_dist_keys.size(); i += NUM_THREADS) {
-         auto &hand = hand_dist_keys[i];
-         hand_distribution.at(hand).delayed_observations.emplace_back(
-           simulserver, fp, me, hand
+       for (size_t i = t; i < hand_distribution.size(); i += NUM_THREADS) {
+         hand_distribution.val(i).delayed_observations.emplace_back(
+           simulserver, fp, me, hand_distribution.packed(i)
          );
          // simulserver.hands_[me] = hand;
          // for (int p = 0; p < numPlayers(); p++) {
@@ -540,23 +489,118 @@ void FactorizedBeliefs::log() {
    for (auto &f: futures) {
      f.get();
    }
-   std::cerr << now() << "applyToAll end" << std::endl;
+   HANABI_LOG(DEBUG, Bots) << "applyToAll end";
  }
 
+template<int NumPlayers, int HandSize>
+const RolloutServer::Kernels &RolloutServer::kernels_() {
+  static const Kernels kernels = {
+    &RolloutServer::runToCompletion_<true, NumPlayers, HandSize>,
+    &RolloutServer::pleaseDiscard_<true, NumPlayers, HandSize>,
+    &RolloutServer::pleasePlay_<true, NumPlayers, HandSize>,
+    &RolloutServer::pleaseGiveColorHint_<true, NumPlayers, HandSize>,
+    &RolloutServer::pleaseGiveValueHint_<true, NumPlayers, HandSize>,
+  };
+  return kernels;
+}
+
+void RolloutServer::selectKernels_() {
+  switch (numPlayers() * 10 + handSize()) {
+    case 25: kernels_ptr_ = &kernels_<2, 5>(); break;
+    case 35: kernels_ptr_ = &kernels_<3, 5>(); break;
+    case 44: kernels_ptr_ = &kernels_<4, 4>(); break;
+    case 54: kernels_ptr_ = &kernels_<5, 4>(); break;
+    default: kernels_ptr_ = &kernels_<0, 0>(); break;
+  }
+}
+
+void RolloutServer::sync(const Server &s) {
+  SimulServer::sync(s);
+  selectKernels_();
+}
+
+int RolloutServer::runToCompletion() {
+  return (this->*kernels_ptr_->runToCompletion)();
+}
+
+void RolloutServer::pleaseDiscard(int index) {
+  if (mock_) {
+    SimulServer::pleaseDiscard(index);
+  } else {
+    (this->*kernels_ptr_->discard)(index);
+  }
+}
+
+void RolloutServer::pleasePlay(int index) {
+  if (mock_) {
+    SimulServer::pleasePlay(index);
+  } else {
+    (this->*kernels_ptr_->play)(index);
+  }
+}
+
+void RolloutServer::pleaseGiveColorHint(int player, Color color) {
+  if (mock_) {
+    SimulServer::pleaseGiveColorHint(player, color);
+  } else {
+    (this->*kernels_ptr_->colorHint)(player, color);
+  }
+}
+
+void RolloutServer::pleaseGiveValueHint(int player, Value value) {
+  if (mock_) {
+    SimulServer::pleaseGiveValueHint(player, value);
+  } else {
+    (this->*kernels_ptr_->valueHint)(player, value);
+  }
+}
+
+template<class ServerT>
+static std::pair<double, double> timeRollouts_(const std::string &botName, int numPlayers, int numRollouts) {
+  auto factory = getBotFactory(botName);
+  ServerT server(numPlayers);
+  long total_score = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < numRollouts; i++) {
+    server.deal(i);
+    BotVec bots;
+    for (int p = 0; p < numPlayers; p++) {
+      bots.push_back(std::shared_ptr<Bot>(factory->create(p, numPlayers, server.handSize())));
+    }
+    server.setPlayers(bots);
+    total_score += server.runToCompletion();
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return std::make_pair(numRollouts / elapsed.count(), (double) total_score / numRollouts);
+}
+
+std::pair<double, double> benchmarkRollouts(const std::string &botName, int numPlayers, int numRollouts, bool lean) {
+  if (lean) {
+    return timeRollouts_<RolloutServer>(botName, numPlayers, numRollouts);
+  } else {
+    return timeRollouts_<SimulServer>(botName, numPlayers, numRollouts);
+  }
+}
+
 void HandDistVal::applyObservations() {
-  for (int p = 0; p < partners.size(); p++) {
-    if (partners[p]) {
-      partners[p] = getPartner(p);
+  if (delayed_observations.empty()) {
+    return;
+  }
+  auto updated = std::make_shared<BotVec>(partners->size());
+  for (int p = 0; p < partners->size(); p++) {
+    if ((*partners)[p]) {
+      (*updated)[p] = getPartner(p);
     }
   }
+  partners = updated;
   delayed_observations.clear();
 }
 
 std::shared_ptr<Bot> HandDistVal::getPartner(int who) const {
-  auto bot = std::shared_ptr<Bot>(partners[who]->clone());
+  auto bot = std::shared_ptr<Bot>((*partners)[who]->clone());
   for (auto &obs: delayed_observations) {
     SimulServer simulserver(*obs.server);
-    simulserver.setHand(obs.who, obs.hand);
+    simulserver.setHand(obs.who, unpackHand(obs.hand));
     assert (who != obs.who);
     simulserver.setObservingPlayer(who);
     (*obs.func)(bot.get(), simulserver);
@@ -564,15 +608,197 @@ std::shared_ptr<Bot> HandDistVal::getPartner(int who) const {
   return bot;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// HandDist
+
+// hands per fiber when filtering; smaller ranges are filtered in place
+static constexpr size_t HAND_DIST_BLOCK = 1 << 16;
+
+void HandDist::clear() {
+  hands_.clear();
+  probs_.clear();
+  vals_.clear();
+  index_();
+}
+
+void HandDist::reserve(size_t n) {
+  hands_.reserve(n);
+  probs_.reserve(n);
+  vals_.reserve(n);
+}
+
+size_t HandDist::find(const Hand &hand) const {
+  if (indexed_size_ > 0) {
+    if (hand.size() != indexed_size_) {
+      return npos;
+    }
+    const uint32_t index = handIndex(hand);
+    const uint64_t word = members_[index / 64];
+    const uint64_t bit = (uint64_t) 1 << (index % 64);
+    return (word & bit) ? ranks_[index / 64] + __builtin_popcountll(word & (bit - 1)) : npos;
+  }
+  PackedHand packed = packHand(hand);
+  auto it = std::lower_bound(hands_.begin(), hands_.end(), packed);
+  return (it != hands_.end() && *it == packed) ? it - hands_.begin() : npos;
+}
+
+void HandDist::push_back(PackedHand hand, float prob, HandDistVal val) {
+  indexed_size_ = 0;
+  hands_.push_back(hand);
+  probs_.push_back(prob);
+  vals_.push_back(std::move(val));
+}
+
+void HandDist::sort() {
+  if (indexed_size_ > 0) {
+    return;  // nothing has been added since it was indexed
+  }
+  if (std::is_sorted(hands_.begin(), hands_.end())) {
+    index_();
+    return;
+  }
+  std::vector<uint32_t> order(size());
+  for (size_t i = 0; i < order.size(); i++) order[i] = i;
+  std::sort(order.begin(), order.end(), [this](uint32_t l, uint32_t r) { return hands_[l] < hands_[r]; });
+  std::vector<PackedHand> hands(size());
+  std::vector<float> probs(size());
+  std::vector<HandDistVal> vals(size());
+  for (size_t i = 0; i < order.size(); i++) {
+    hands[i] = hands_[order[i]];
+    probs[i] = probs_[order[i]];
+    vals[i] = std::move(vals_[order[i]]);
+    assert(i == 0 || hands[i - 1] != hands[i]);
+  }
+  hands_.swap(hands);
+  probs_.swap(probs);
+  vals_.swap(vals);
+  index_();
+}
+
+void HandDist::index_() {
+  indexed_size_ = 0;
+  const int hand_size = empty() ? 0 : unpackHand(hands_[0]).size();
+  const uint32_t num_indices = numHandIndices(hand_size);
+  // not worth it unless the bitset is no bigger than the hands themselves
+  if (empty() || size() * 64 < num_indices) {
+    std::vector<uint64_t>().swap(members_);
+    std::vector<uint32_t>().swap(ranks_);
+    return;
+  }
+  members_.assign((num_indices + 63) / 64, 0);
+  for (PackedHand hand : hands_) {
+    const uint32_t index = handIndex(hand);
+    members_[index / 64] |= (uint64_t) 1 << (index % 64);
+  }
+  indexed_size_ = hand_size;
+  rank_();
+}
+
+void HandDist::rank_() {
+  ranks_.resize(members_.size());
+  uint32_t rank = 0;
+  for (size_t w = 0; w < members_.size(); w++) {
+    ranks_[w] = rank;
+    rank += __builtin_popcountll(members_[w]);
+  }
+  assert(rank == size());  // the hands are distinct, and all of indexed_size_ cards
+}
+
+size_t HandDist::memoryUsage() const {
+  size_t bytes = hands_.capacity() * sizeof(PackedHand)
+               + probs_.capacity() * sizeof(float)
+               + vals_.capacity() * sizeof(HandDistVal)
+               + members_.capacity() * sizeof(uint64_t)
+               + ranks_.capacity() * sizeof(uint32_t);
+  for (auto &val : vals_) {
+    bytes += val.delayed_observations.capacity() * sizeof(ObservationThunk);
+  }
+  return bytes;
+}
+
+void HandDist::forEachBlock(const std::function<void(size_t, size_t)> &f) const {
+  const size_t n = size();
+  if (n <= HAND_DIST_BLOCK) {
+    f(0, n);
+    return;
+  }
+  std::vector<boost::fibers::future<void>> futures;
+  for (size_t begin = 0; begin < n; begin += HAND_DIST_BLOCK) {
+    futures.push_back(getThreadPool().enqueue([&f, begin, n]() {
+      f(begin, std::min(begin + HAND_DIST_BLOCK, n));
+    }));
+  }
+  for (auto &future: futures) {
+    future.get();
+  }
+}
+
+void HandDist::compact_(const std::vector<uint8_t> &keep) {
+  if (empty()) {
+    return;
+  }
+  // each block moves the hands it keeps to just after those kept by the
+  // blocks before it, and frees the values of those it drops, which (with
+  // their observations) is most of the work of a large filter. It also
+  // takes the dropped hands out of the index, rather than have it rebuilt;
+  // neighbouring blocks can share a word of it.
+  const size_t num_blocks = (size() + HAND_DIST_BLOCK - 1) / HAND_DIST_BLOCK;
+  std::vector<size_t> offsets(num_blocks + 1, 0);
+  forEachBlock([&](size_t begin, size_t end) {
+    offsets[begin / HAND_DIST_BLOCK + 1] = std::count(keep.begin() + begin, keep.begin() + end, 1);
+  });
+  for (size_t b = 0; b < num_blocks; b++) {
+    offsets[b + 1] += offsets[b];
+  }
+  const size_t kept = offsets[num_blocks];
+  if (kept == size()) {
+    return;
+  }
+  std::vector<PackedHand> hands(kept);
+  std::vector<float> probs(kept);
+  std::vector<HandDistVal> vals(kept);
+  forEachBlock([&](size_t begin, size_t end) {
+    size_t j = offsets[begin / HAND_DIST_BLOCK];
+    for (size_t i = begin; i < end; i++) {
+      if (keep[i]) {
+        hands[j] = hands_[i];
+        probs[j] = probs_[i];
+        vals[j] = std::move(vals_[i]);
+        j++;
+      } else {
+        vals_[i] = HandDistVal();
+        if (indexed_size_ > 0) {
+          const uint32_t index = handIndex(hands_[i]);
+          __atomic_fetch_and(&members_[index / 64], ~((uint64_t) 1 << (index % 64)), __ATOMIC_RELAXED);
+        }
+      }
+    }
+  });
+  hands_.swap(hands);
+  probs_.swap(probs);
+  vals_.swap(vals);
+  if (indexed_size_ > 0 && size() * 64 >= numHandIndices(indexed_size_)) {
+    rank_();
+  } else {
+    index_();
+  }
+}
+
+void releaseFreedMemory() {
+#ifdef __GLIBC__
+  malloc_trim(0);
+#endif
+}
+
  // handDistCDF
 
  HandDistCDF populateHandDistPDF(const HandDist &handDist) {
    HandDistCDF cdf;
    cdf.hands.reserve(handDist.size());
    cdf.probs.reserve(handDist.size());
-   for (auto &kv : handDist) {
-     cdf.hands.push_back(kv.first);
-     cdf.probs.push_back(kv.second.prob);
+   for (size_t i = 0; i < handDist.size(); i++) {
+     cdf.hands.push_back(handDist.packed(i));
+     cdf.probs.push_back(handDist.prob(i));
    }
    return cdf;
  }
@@ -14,14 +14,14 @@
 #include <functional>
 #include <fstream>
 #include <array>
+#include <cstdint>
+#include <vector>
 
 typedef enum {PLAY_CARD, DISCARD_CARD, HINT_COLOR, HINT_VALUE, INVALID_MOVE } MoveType;
 
 const int NUMMOVETYPES = 5;
 
 
-std::string now();
-
 struct Move {
   MoveType type;
   int value;
@@ -38,24 +38,42 @@ bool operator<(const Move& l, const Move& r);
 bool operator==(const Move& l, const Move& r);
 bool operator!=(const Move& l, const Move& r);
 
-std::vector<Move> enumerateLegalMoves(const Hanabi::Server &server);
+// at most two moves per card in my hand, plus every possible hint
+constexpr int MAXMOVES = 2 * Hanabi::MAXHANDSIZE + (Hanabi::MAXPLAYERS - 1) * (Hanabi::NUMCOLORS + Hanabi::VALUE_MAX);
+typedef Hanabi::FixedVector<Move, MAXMOVES> MoveList;
+
+/* All legal moves for the observing player, sorted as by operator<. */
+MoveList enumerateLegalMoves(const Hanabi::Server &server);
+
+// a hand lives inline (no heap allocation), same as the server's hands
+typedef Hanabi::HandArray Hand;
+
+// a hand packed one card to a byte: card i is byte i, with its color in the
+// high nibble and its value in the low one, so no card packs to zero and
+// the bytes past the end of the hand are zero
+typedef uint64_t PackedHand;
+static_assert(Hanabi::MAXHANDSIZE <= 8, "a hand must pack into a PackedHand");
 
-typedef std::vector<Hanabi::Card> Hand;
+inline PackedHand packHand(const Hand &hand) {
+  PackedHand packed = 0;
+  for (int i = 0; i < hand.size(); i++) {
+    packed |= (PackedHand) (((int) hand[i].color << 4) | (int) hand[i].value) << (8 * i);
+  }
+  return packed;
+}
 
-#ifndef CARD_ID
-// shortcut
-template <>
-inline bool std::operator< (const Hand &l, const Hand &r) {
-  if (l.size() != r.size()) return l.size() < r.size();
-  return memcmp(&l[0], &r[0], l.size() * sizeof(Hanabi::Card)) < 0;
+inline Hand unpackHand(PackedHand packed) {
+  Hand hand;
+  for (; packed != 0; packed >>= 8) {
+    hand.push_back(Hanabi::Card((Hanabi::Color) ((packed >> 4) & 0xf), (int) (packed & 0xf)));
+  }
+  return hand;
 }
-#endif
 
 std::string handAsString(const Hand &hand);
 
 std::string colorname(Hanabi::Color color);
 
-/* A map from card to the number of cards of that value remaining in the deck. */
 typedef std::vector<std::shared_ptr<Hanabi::Bot>> BotVec;
 
 BotVec cloneBotVec(const BotVec &vec, int who);
@@ -63,10 +81,67 @@ BotVec cloneBotVec(const BotVec &vec, int who);
 typedef std::function<void(Hanabi::Bot*, const Hanabi::Server &server)> ObservationFunc;
 
 
-// deck composition
-typedef std::map<Hanabi::Card, int> DeckComposition;
+inline int cardToIndex(Hanabi::Card card) {
+  return card.index();
+}
+
+inline Hanabi::Card indexToCard(int index) {
+  return Hanabi::Card((Hanabi::Color) (index / 5), index % 5 + Hanabi::ONE);
+}
+
+// hands numbered densely: a hand of n cards is the n-digit number, base
+// NUMCARDTYPES, whose digit i is cardToIndex(hand[i]). So hands of n cards
+// are numbered below numHandIndices(n) (under 10M for 5 cards), in the
+// same order as their packed hands.
+inline uint32_t numHandIndices(int size) {
+  uint32_t num = 1;
+  for (int i = 0; i < size; i++) num *= Hanabi::NUMCARDTYPES;
+  return num;
+}
+
+inline uint32_t handIndex(const Hand &hand) {
+  uint32_t index = 0;
+  for (int i = hand.size() - 1; i >= 0; i--) {
+    index = index * Hanabi::NUMCARDTYPES + cardToIndex(hand[i]);
+  }
+  return index;
+}
+
+inline uint32_t handIndex(PackedHand packed) {
+  uint32_t index = 0, place = 1;
+  for (; packed != 0; packed >>= 8) {
+    index += (((packed >> 4) & 0xf) * Hanabi::VALUE_MAX + (packed & 0xf) - Hanabi::ONE) * place;
+    place *= Hanabi::NUMCARDTYPES;
+  }
+  return index;
+}
+
+inline Hand handFromIndex(uint32_t index, int size) {
+  Hand hand;
+  for (int i = 0; i < size; i++) {
+    hand.push_back(indexToCard(index % Hanabi::NUMCARDTYPES));
+    index /= Hanabi::NUMCARDTYPES;
+  }
+  return hand;
+}
+
+// deck composition: the number of each card remaining in the deck, as a
+// dense table indexed by cardToIndex(). Index order is the same as card
+// order, so iterating 0..NUMCARDS visits cards in sorted order.
+struct DeckComposition {
+  static constexpr int NUMCARDS = Hanabi::NUMCARDTYPES;
+
+  DeckComposition() : counts() {}
+
+  int &operator[](Hanabi::Card card) { return counts[cardToIndex(card)]; }
+  int operator[](Hanabi::Card card) const { return counts[cardToIndex(card)]; }
+
+  std::array<int, NUMCARDS> counts;
+};
 void addToDeck(const std::vector<Hanabi::Card> &cards, DeckComposition &deck);
+void addToDeck(const Hand &cards, DeckComposition &deck);
 void removeFromDeck(const std::vector<Hanabi::Card> &cards, DeckComposition &deck);
+void removeFromDeck(const Hand &cards, DeckComposition &deck);
 DeckComposition getCurrentDeckComposition(const Hanabi::Server &server, int who);
 
 // search stats
@@ -155,39 +230,18 @@ private:
 };
 
 int moveToIndex(Move move, const Hanabi::Server &server);
-int cardToIndex(Hanabi::Card card);
-Hanabi::Card indexToCard(int index);
-
-// a memory optimization to store hands more efficiently
-class BoxedHand {
-public:
-  BoxedHand(const Hand &hand);
-  BoxedHand(const BoxedHand &hand) { pHand = hand.pHand; }
-
-  operator const Hand&() const { return *pHand; }
-
-  const Hanabi::Card &operator[] (int index) const { return (*pHand)[index]; }
-  const Hand& get() { return *pHand; }
-  int size() {return pHand->size(); }
-  bool operator== (const BoxedHand &r) const { return this->pHand == r.pHand; }
-  bool operator!= (const BoxedHand &r) const { return this->pHand != r.pHand; }
-  bool operator< (const BoxedHand &r) const { return this->pHand < r.pHand; }
-
-private:
-  Hand *pHand;
-};
 
 class SimulServer;
 struct ObservationThunk {
   std::shared_ptr<SimulServer> server;
   std::shared_ptr<ObservationFunc> func;
   int who;
-  BoxedHand hand;
+  PackedHand hand;
   ObservationThunk(
     std::shared_ptr<SimulServer> server,
     std::shared_ptr<ObservationFunc> func,
     int who,
-    BoxedHand hand)
+    PackedHand hand)
     : server(server)
     , func(func)
     , who(who)
@@ -196,21 +250,113 @@ struct ObservationThunk {
 
 typedef std::vector<ObservationThunk> ObservationList;
 
+// the partner bots, were I to hold one hand of a HandDist
 struct HandDistVal {
-  float prob;
   ObservationList delayed_observations;
 
-  HandDistVal(): prob(0), partners() {}
-  HandDistVal(float prob, BotVec partners): prob(prob), partners(partners) {}
+  HandDistVal(): partners() {}
+  // partners is shared with every other hand until observations are applied
+  explicit HandDistVal(std::shared_ptr<const BotVec> partners): partners(partners) {}
 
   void applyObservations();
   std::shared_ptr<Hanabi::Bot> getPartner(int who) const;
 
 private:
-  BotVec partners; // these are lazily updated so should only be accessed through getPartner()!
+  std::shared_ptr<const BotVec> partners; // these are lazily updated so should only be accessed through getPartner()!
+};
+
+// A belief range: the hands a player may hold, each with its probability
+// and its HandDistVal. These are kept in parallel arrays sorted by packed
+// hand, so a filter is a pass over contiguous memory (in parallel, for
+// large ranges) rather than a walk over tree nodes.
+//
+// A range with enough hands to be worth it is also indexed: a bitset of
+// its hands by handIndex(), with a count of the hands before each word of
+// it. Then find() is a bit test and a popcount instead of a binary search,
+// and the arrays are, in effect, sparse arrays keyed by handIndex().
+class HandDist {
+public:
+  static constexpr size_t npos = (size_t) -1;
+
+  size_t size() const { return hands_.size(); }
+  bool empty() const { return hands_.empty(); }
+  void clear();
+  void reserve(size_t n);
+
+  PackedHand packed(size_t i) const { return hands_[i]; }
+  const PackedHand *packedHands() const { return hands_.data(); }
+  Hand hand(size_t i) const { return unpackHand(hands_[i]); }
+  float prob(size_t i) const { return probs_[i]; }
+  float &prob(size_t i) { return probs_[i]; }
+  float *probs() { return probs_.data(); }
+  const HandDistVal &val(size_t i) const { return vals_[i]; }
+  HandDistVal &val(size_t i) { return vals_[i]; }
+
+  // the bytes the range takes up, not counting the partner bots and
+  // observed servers, which are shared between hands
+  size_t memoryUsage() const;
+
+  // where hand is in the range, or npos if it isn't
+  size_t find(const Hand &hand) const;
+  size_t count(const Hand &hand) const { return find(hand) == npos ? 0 : 1; }
+
+  // Adds a hand at the end of the range. Call sort() once they are all
+  // added, to put them in order and index them.
+  void push_back(PackedHand hand, float prob, HandDistVal val);
+  void sort();
+
+  // Keeps only the hands i for which keep(i) is true, in order; keep may
+  // also update prob(i). For large ranges keep is called from the thread
+  // pool, a block of hands per fiber.
+  template<typename Keep>
+  void filter(const Keep &keep);
+  // The same, for kernels that decide a block of hands at once:
+  // mark(begin, end, keep) sets keep[i - begin] for each hand i in the block.
+  template<typename Mark>
+  void filterBlocks(const Mark &mark);
+  void eraseZeroProb() { filter([this](size_t i) { return probs_[i] != 0; }); }
+
+  // Calls f(begin, end) for blocks of hands that cover the range, in
+  // parallel if there are enough of them.
+  void forEachBlock(const std::function<void(size_t, size_t)> &f) const;
+
+private:
+  void compact_(const std::vector<uint8_t> &keep);
+  void index_();
+  void rank_();
+
+  std::vector<PackedHand> hands_;
+  std::vector<float> probs_;
+  std::vector<HandDistVal> vals_;
+  // the index, if indexed_size_ > 0: for hands of that many cards
+  int indexed_size_ = 0;
+  std::vector<uint64_t> members_;
+  std::vector<uint32_t> ranks_;
 };
 
-typedef std::map<BoxedHand, HandDistVal> HandDist;
+template<typename Keep>
+void HandDist::filter(const Keep &keep) {
+  filterBlocks([&](size_t begin, size_t end, uint8_t *mask) {
+    for (size_t i = begin; i < end; i++) {
+      mask[i - begin] = keep(i);
+    }
+  });
+}
+
+template<typename Mark>
+void HandDist::filterBlocks(const Mark &mark) {
+  std::vector<uint8_t> mask(size());
+  forEachBlock([&](size_t begin, size_t end) {
+    mark(begin, end, mask.data() + begin);
+  });
+  compact_(mask);
+}
+
+// Returns the memory that has been freed, but that malloc is holding on
+// to, to the OS. Search bots free their beliefs (hundreds of MB, in large
+// blocks) when they are destroyed; without this, a process that plays game
+// after game keeps the high-water mark of every game before.
+void releaseFreedMemory();
 
 
 class SimulServer : public Hanabi::Server {
@@ -228,8 +374,10 @@ public:
    * with all information to the observing player. The hidden information
    * (my hand, the deck) are filled with junk cards. */
   virtual void sync(const Hanabi::Server &s);
-  void setHand(int index, Hand my_hand);
-  void setDeck(const std::vector<Hanabi::Card> &deck);
+  void setHand(int index, const Hand &my_hand);
+  void setDeck(const Hanabi::DeckArray &deck);
+  /* Start a new game on this server, shuffling the deck with the given seed. */
+  void deal(unsigned int seed);
 
   /* Simulate the bot making a move, and return what the move was. */
   Move simulatePlayerMove(int index, Hanabi::Bot *bot);
@@ -237,7 +385,7 @@ public:
    * This observation is applied to the server's bot for me_, and to all
    * possible partner bots corresponding to every possible hand I may have in
    * my hand distribution. */
-   // n.b. the map is const, the values are not const!
+   // n.b. the hands are const, the values are not const!
   void applyToAll(ObservationFunc f, HandDist &hand_distribution, int me, bool update_me=true);
 
 
@@ -251,19 +399,51 @@ public:
   Move last_move_;
 };
 
+/* A SimulServer for rollouts: it never logs, formats no strings, and
+ * skips the checks that only catch illegal moves. The bots had better
+ * play legally; given that, it plays out exactly as a SimulServer would. */
+class RolloutServer : public SimulServer {
+public:
+  RolloutServer(int numPlayers) : SimulServer(numPlayers) { selectKernels_(); }
+  RolloutServer(const Hanabi::Server &server) : SimulServer(server) { selectKernels_(); }
+
+  void sync(const Hanabi::Server &s) override;
+  int runToCompletion();
+
+  void pleaseDiscard(int index) override;
+  void pleasePlay(int index) override;
+  void pleaseGiveColorHint(int player, Hanabi::Color color) override;
+  void pleaseGiveValueHint(int player, Hanabi::Value value) override;
+
+private:
+  // the lean game loop and mutators, specialized for one shape of game
+  struct Kernels {
+    int (Hanabi::Server::*runToCompletion)(void);
+    void (Hanabi::Server::*discard)(int);
+    void (Hanabi::Server::*play)(int);
+    void (Hanabi::Server::*colorHint)(int, Hanabi::Color);
+    void (Hanabi::Server::*valueHint)(int, Hanabi::Value);
+  };
+  template<int NumPlayers, int HandSize> static const Kernels &kernels_();
+  // chosen whenever the shape of the game may have changed
+  void selectKernels_();
+  const Kernels *kernels_ptr_;
+};
+
+/* Play numRollouts games of botName on a RolloutServer (if lean) or a
+ * SimulServer, each dealt from a different seed. Returns the number of
+ * rollouts per second, and the mean score. */
+std::pair<double, double> benchmarkRollouts(const std::string &botName, int numPlayers, int numRollouts, bool lean);
 
-template<typename K, typename V>
-std::vector<K> copyKeys(const std::map<K, V>& map) {
-  std::vector<K> res;
-  for (auto &kv : map) {
-    res.push_back(kv.first);
-  }
-  return res;
-}
 
+// in the same order as the HandDist it was populated from, i.e. sorted by
+// PackedHand. That order is the same on every run, unlike the interned-pointer
+// order of the old std::map, but it is a different order: a given draw from
+// gen samples a different hand than it used to, so searches (and whole games)
+// on the same seed don't match those of the map-based range.
 struct HandDistCDF {
   std::vector<double> probs;
-  std::vector<BoxedHand> hands;
+  std::vector<PackedHand> hands;
 };
 
 /* Converts the hand belief distribution into a CDF form that can be sampled
@@ -0,0 +1,484 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <ctime>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Hanabi.h"
+#include "Eval.h"
+#include "GameRecord.h"
+#include "Metrics.h"
+
+using namespace Hanabi;
+
+////////////////////////////////////////////////////////////////////////////////
+// Test harness code
+////////////////////////////////////////////////////////////////////////////////
+
+struct Statistics {
+    int games;
+    int totalScore;
+    int scoreDistribution[26];
+    int mulligansUsed[4];
+};
+
+static void dump_stats(std::string botname, Statistics stats)
+{
+    const double dgames = stats.games;
+    const int perfectGames = stats.scoreDistribution[25];
+
+    std::cout << "Over " << stats.games << " games, " << botname << " scored an average of "
+              << (stats.totalScore / dgames) << " points per game.\n";
+    if (perfectGames != 0) {
+        const double winRate = 100*(perfectGames / dgames);
+        std::cout << "  " << winRate << " percent were perfect games.\n";
+    }
+    if (stats.mulligansUsed[0] != stats.games) {
+        std::cout << "  Mulligans used: 0 (" << 100*(stats.mulligansUsed[0] / dgames)
+                  << "%); 1 (" << 100*(stats.mulligansUsed[1] / dgames)
+                  << "%); 2 (" << 100*(stats.mulligansUsed[2] / dgames)
+                  << "%); 3 (" << 100*(stats.mulligansUsed[3] / dgames) << "%).\n";
+    }
+}
+
+static void add_game(Statistics &stats, int score, int mulligansUsed)
+{
+    assert(0 <= mulligansUsed && mulligansUsed <= 3);
+    stats.games++;
+    stats.totalScore += score;
+    stats.scoreDistribution[score] += 1;
+    stats.mulligansUsed[mulligansUsed] += 1;
+}
+
+/* The seed for game number `game` of an evaluation seeded with `seed`.
+ * Each game gets its own stream, so the games can be played in any
+ * order and on any thread without changing the results. */
+static unsigned int game_seed(int seed, int game)
+{
+    /* splitmix64 */
+    uint64_t x = ((uint64_t)(unsigned int)seed << 32) | (unsigned int)game;
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return (unsigned int)(x ^ (x >> 31));
+}
+
+/* Call playGame(i) for each game index i, spread over `jobs` threads.
+ * Each call must use its own server and bots. If a game throws, no more
+ * games are started, and the first exception is rethrown here once the
+ * games in progress have finished, as it would be by a serial loop. */
+static void for_each_game_parallel(int games, int jobs, const std::function<void(int)> &playGame)
+{
+    std::atomic<int> nextGame(0);
+    std::exception_ptr error;
+    std::mutex errorMutex;
+    std::vector<std::thread> threads;
+    for (int j=0; j < std::max(jobs, 1); ++j) {
+        threads.emplace_back([&]() {
+            for (int i = nextGame++; i < games; i = nextGame++) {
+                try {
+                    playGame(i);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    if (!error) error = std::current_exception();
+                    nextGame = games;
+                }
+            }
+        });
+    }
+    for (auto &thread : threads) thread.join();
+    if (error) std::rethrow_exception(error);
+}
+
+/* Play each game on its own server with its own bots, spread over
+ * `jobs` threads, then report them in order as if played serially. */
+static void eval_bot_parallel(const std::string &botname, int players, int games, int log_every, int seed, int jobs,
+                              GameRecordWriter *writer, MetricsWriter *metrics)
+{
+    auto botFactory = getBotFactory(botname);
+    std::vector<GameRecord> records(games);
+    std::vector<std::vector<MoveSample>> samples(metrics ? games : 0);
+    for_each_game_parallel(games, jobs, [&](int i) {
+        Hanabi::Server server;
+        server.setRecord(&records[i]);
+        server.srand(game_seed(seed, i));
+        if (metrics) {
+            server.runGame(MeteredBotFactory(*botFactory, &samples[i]), players);
+        } else {
+            server.runGame(*botFactory, players);
+        }
+    });
+
+    Statistics stats = {};
+    for (int i=0; i < games; ++i) {
+        std::cout << "Final score " << i << " : " << records[i].score << " bomb: "
+                  << (records[i].mulligansUsed == NUMMULLIGANS ? 1 : 0) << std::endl;
+        add_game(stats, records[i].score, records[i].mulligansUsed);
+        if (writer) writer->write(records[i]);
+        if (metrics) metrics->write(i, records[i], samples[i]);
+        if (i % log_every == 0) {
+          dump_stats(botname, stats);
+        }
+    }
+    dump_stats(botname, stats);
+}
+
+static int pick_seed(int seed)
+{
+    // special case slurm runs
+    if (seed < 0 && std::getenv("SLURM_PROCID")) {
+      // CAREFUL! make sure this doesn't wrap around and become negative
+      seed = (std::stol(std::getenv("SLURM_JOBID")) + std::stol(std::getenv("SLURM_PROCID")) * 102797) % 1000000000;
+      printf("Set seed from slurm to %d\n", seed);
+    }
+    if (seed <= 0) {
+        std::srand(std::time(NULL));
+        seed = std::rand();
+    }
+    printf("--seed %d\n", seed);
+    return seed;
+}
+
+void eval_bot(
+  std::string botname,
+  int players,
+  int games,
+  int log_every,
+  int seed,
+  int jobs,
+  std::string record_path,
+  std::string metrics_path
+) {
+    seed = pick_seed(seed);
+
+    /* If asked, write a GameRecord of every game to record_path,
+     * and per-game and per-move metrics to metrics_path. */
+    std::unique_ptr<GameRecordWriter> writer;
+    if (!record_path.empty()) writer.reset(new GameRecordWriter(record_path));
+    std::unique_ptr<MetricsWriter> metrics;
+    if (!metrics_path.empty()) metrics.reset(new MetricsWriter(metrics_path));
+
+    /* So that the first game's latencies don't include the setup. */
+    if (metrics) Hanabi::warmUp(botname, players);
+
+    if (jobs > 0) {
+        eval_bot_parallel(botname, players, games, log_every, seed, jobs, writer.get(), metrics.get());
+        Hanabi::closeThreadPool();
+        return;
+    }
+
+    Statistics stats = {};
+
+    Hanabi::Server server;
+    server.setLog(&std::cerr);
+    GameRecord record;
+    if (writer || metrics) server.setRecord(&record);
+    auto botFactory = getBotFactory(botname);
+    std::vector<MoveSample> samples;
+    MeteredBotFactory meteredFactory(*botFactory, &samples);
+
+    server.srand(seed);
+
+    for (int i=0; i < games; ++i) {
+        samples.clear();
+        int score = server.runGame(metrics ? meteredFactory : *botFactory, players);
+        std::cout << "Final score " << i << " : " << score << " bomb: "
+                  << (server.mulligansRemaining() == 0 ? 1 : 0) << std::endl;
+        assert(score == server.currentScore());
+        add_game(stats, score, server.mulligansUsed());
+        if (writer) writer->write(record);
+        if (metrics) metrics->write(i, record, samples);
+
+        if (i % log_every == 0) {
+          dump_stats(botname, stats);
+        }
+    }
+    dump_stats(botname, stats);
+
+    Hanabi::closeThreadPool();
+}
+
+void eval_games(
+  std::string botname,
+  int players,
+  int seed,
+  std::vector<int> games,
+  std::string results_path,
+  int jobs
+) {
+    auto botFactory = getBotFactory(botname);
+    MetricsWriter results(results_path, /*append=*/true);
+    std::mutex resultsMutex;
+    for_each_game_parallel(games.size(), jobs, [&](int k) {
+        GameRecord record;
+        Hanabi::Server server;
+        server.setRecord(&record);
+        server.srand(game_seed(seed, games[k]));
+        server.runGame(*botFactory, players);
+        std::lock_guard<std::mutex> lock(resultsMutex);
+        results.writeGame(games[k], record);
+    });
+    Hanabi::closeThreadPool();
+}
+
+
+
+struct PairedStatistics {
+    int games;
+    int totalScore[2];
+    double sumDiff;  /* of B's score minus A's */
+    double sumSquaredDiff;
+    int wins[2];
+    int ties;
+};
+
+static void add_paired_game(PairedStatistics &stats, int scoreA, int scoreB)
+{
+    const int diff = scoreB - scoreA;
+    stats.games++;
+    stats.totalScore[0] += scoreA;
+    stats.totalScore[1] += scoreB;
+    stats.sumDiff += diff;
+    stats.sumSquaredDiff += diff * diff;
+    if (diff < 0) stats.wins[0] += 1;
+    else if (diff > 0) stats.wins[1] += 1;
+    else stats.ties += 1;
+}
+
+static void dump_paired_stats(const std::string &botA, const std::string &botB, const PairedStatistics &stats)
+{
+    const double dgames = stats.games;
+    const double mean = stats.sumDiff / dgames;
+    /* A 95% confidence interval, from the normal approximation. */
+    const double var = (stats.games > 1) ? (stats.sumSquaredDiff - dgames * mean * mean) / (dgames - 1) : 0;
+    const double halfWidth = 1.96 * std::sqrt(std::max(var, 0.0) / dgames);
+
+    std::cout << "Over " << stats.games << " paired games, " << botA << " scored an average of "
+              << (stats.totalScore[0] / dgames) << " and " << botB << " scored an average of "
+              << (stats.totalScore[1] / dgames) << " points per game.\n";
+    std::cout << "  " << botB << " - " << botA << ": " << mean << " +/- " << halfWidth
+              << " (95% CI [" << (mean - halfWidth) << ", " << (mean + halfWidth) << "]).\n";
+    std::cout << "  " << botA << " won " << stats.wins[0] << ", " << botB << " won " << stats.wins[1]
+              << ", " << stats.ties << " tied.\n";
+}
+
+void eval_paired(
+  std::string botA,
+  std::string botB,
+  int players,
+  int games,
+  int log_every,
+  int seed,
+  int jobs
+) {
+    seed = pick_seed(seed);
+
+    const std::shared_ptr<Hanabi::BotFactory> botFactories[2] = { getBotFactory(botA), getBotFactory(botB) };
+    std::vector<std::array<int, 2>> scores(games);
+    for_each_game_parallel(games, jobs, [&](int i) {
+        const std::vector<Card> deck = shuffledDeck(game_seed(seed, i));
+        for (int k=0; k < 2; ++k) {
+            Hanabi::Server server;
+            server.srand(game_seed(seed, i));
+            scores[i][k] = server.runGame(*botFactories[k], players, deck);
+        }
+    });
+
+    PairedStatistics stats = {};
+    for (int i=0; i < games; ++i) {
+        std::cout << "Final scores " << i << " : " << scores[i][0] << " " << scores[i][1] << std::endl;
+        add_paired_game(stats, scores[i][0], scores[i][1]);
+        if (i % log_every == 0) {
+          dump_paired_stats(botA, botB, stats);
+        }
+    }
+    dump_paired_stats(botA, botB, stats);
+
+    Hanabi::closeThreadPool();
+}
+
+/* Makes the bot for each seat with that seat's own factory. When not all
+ * the seats have the same factory, no bot can count on its partners
+ * following its conventions, so each is made permissive. */
+struct LineupBotFactory final : public Hanabi::BotFactory {
+    std::vector<const Hanabi::BotFactory *> seats;
+    mutable std::vector<Bot *> made;
+
+    Bot *create(int index, int numPlayers, int handSize) const override {
+        Bot *bot = seats[index]->create(index, numPlayers, handSize);
+        if (std::count(seats.begin(), seats.end(), seats[0]) != (int)seats.size()) {
+            bot->setPermissive(true);
+        }
+        made.resize(std::max<size_t>(made.size(), index + 1));
+        made[index] = bot;
+        return bot;
+    }
+    void destroy(Bot *bot) const override {
+        const int index = std::find(made.begin(), made.end(), bot) - made.begin();
+        seats[index]->destroy(bot);
+    }
+};
+
+std::vector<std::vector<double>> eval_tournament(
+  std::vector<std::string> botnames,
+  int players,
+  int games,
+  int seed,
+  int jobs,
+  std::string csv_path
+) {
+    seed = pick_seed(seed);
+
+    const int numBots = botnames.size();
+    if (numBots == 0) throw std::runtime_error("no bots to play a tournament");
+    std::vector<std::shared_ptr<Hanabi::BotFactory>> botFactories;
+    for (const std::string &botname : botnames) {
+        botFactories.push_back(getBotFactory(botname));
+    }
+
+    /* Lineup number l puts bot (l / numBots^i) % numBots in seat i. */
+    int numLineups = 1;
+    for (int i=0; i < players; ++i) numLineups *= numBots;
+    auto seatOf = [&](int lineup, int seat) {
+        for (int i=0; i < seat; ++i) lineup /= numBots;
+        return lineup % numBots;
+    };
+    std::cout << "Playing " << numLineups << " lineups of " << games << " games each" << std::endl;
+
+    /* Every lineup plays game i on the same deck. Each game builds its own
+     * bots, but all of them share the factories (and whatever models and
+     * thread pools those hold). */
+    std::vector<int> scores(numLineups * games);
+    for_each_game_parallel(numLineups * games, jobs, [&](int task) {
+        const int lineup = task / games, i = task % games;
+        const std::vector<Card> deck = shuffledDeck(game_seed(seed, i));
+        LineupBotFactory lineupFactory;
+        for (int p=0; p < players; ++p) {
+            lineupFactory.seats.push_back(botFactories[seatOf(lineup, p)].get());
+        }
+        Hanabi::Server server;
+        server.srand(game_seed(seed, i));
+        scores[task] = server.runGame(lineupFactory, players, deck);
+    });
+
+    std::vector<std::vector<double>> matrix(numBots, std::vector<double>(numBots, 0));
+    std::vector<std::vector<int>> counts(numBots, std::vector<int>(numBots, 0));
+    for (int lineup=0; lineup < numLineups; ++lineup) {
+        int total = 0;
+        for (int i=0; i < games; ++i) total += scores[lineup * games + i];
+        std::cout << "Lineup";
+        for (int p=0; p < players; ++p) std::cout << " " << botnames[seatOf(lineup, p)];
+        std::cout << " : " << (total / double(games)) << std::endl;
+        const int a = seatOf(lineup, 0), b = seatOf(lineup, 1);
+        matrix[a][b] += total;
+        counts[a][b] += games;
+    }
+    for (int a=0; a < numBots; ++a) {
+        for (int b=0; b < numBots; ++b) matrix[a][b] /= counts[a][b];
+    }
+
+    std::cout << "Cross-play scores (row: seat 0, column: seat 1):\n";
+    for (int b=0; b < numBots; ++b) std::cout << "\t" << botnames[b];
+    std::cout << "\n";
+    for (int a=0; a < numBots; ++a) {
+        std::cout << botnames[a];
+        for (int b=0; b < numBots; ++b) std::cout << "\t" << matrix[a][b];
+        std::cout << "\n";
+    }
+    std::cout << std::flush;
+
+    if (!csv_path.empty()) {
+        std::ofstream csv(csv_path);
+        if (!csv) throw std::runtime_error("can't open " + csv_path + " for writing");
+        csv << "seat0";
+        for (int b=0; b < numBots; ++b) csv << "," << botnames[b];
+        csv << "\n";
+        for (int a=0; a < numBots; ++a) {
+            csv << botnames[a];
+            for (int b=0; b < numBots; ++b) csv << "," << matrix[a][b];
+            csv << "\n";
+        }
+    }
+
+    Hanabi::closeThreadPool();
+    return matrix;
+}
+
+std::vector<double> eval_sweep(
+  std::string botname,
+  std::vector<std::map<std::string, std::string>> configs,
+  int players,
+  int games,
+  int seed,
+  int jobs
+) {
+    seed = pick_seed(seed);
+
+    if (configs.empty()) throw std::runtime_error("no configurations to sweep");
+    auto botFactory = getBotFactory(botname);
+    std::vector<Params::Context> contexts;
+    for (const auto &config : configs) contexts.emplace_back(config);
+
+    /* A misspelled parameter would just be ignored, and its configuration
+     * reported as if it had been swept; so before playing any games, make
+     * each configuration's bots and check that they read all of it. */
+    for (const auto &context : contexts) {
+        const ParamsBotFactory factory(*botFactory, context);
+        Params::Recorder recorder;
+        for (int i=0; i < players; ++i) {
+            factory.destroy(factory.create(i, players, Server::handSizeFor(players)));
+        }
+        for (const auto &kv : context.values()) {
+            if (recorder.names().count(kv.first) == 0) {
+                throw std::runtime_error("unknown parameter " + kv.first + " for " + botname);
+            }
+        }
+    }
+
+    /* Every configuration plays game i on the same deck, so their
+     * differences aren't swamped by deck-to-deck variance. */
+    const int numConfigs = contexts.size();
+    std::vector<int> scores(numConfigs * games);
+    for_each_game_parallel(numConfigs * games, jobs, [&](int task) {
+        const int c = task / games, i = task % games;
+        const std::vector<Card> deck = shuffledDeck(game_seed(seed, i));
+        Hanabi::Server server;
+        server.srand(game_seed(seed, i));
+        scores[task] = server.runGame(ParamsBotFactory(*botFactory, contexts[c]), players, deck);
+    });
+
+    std::vector<double> means(numConfigs);
+    for (int c=0; c < numConfigs; ++c) {
+        double sum = 0, sumSquared = 0;
+        int perfectGames = 0;
+        for (int i=0; i < games; ++i) {
+            const int score = scores[c * games + i];
+            sum += score;
+            sumSquared += score * score;
+            perfectGames += (score == 25);
+        }
+        means[c] = sum / games;
+        const double variance = (games > 1) ? (sumSquared - sum * means[c]) / (games - 1) : 0;
+        std::cout << "Config " << (configs[c].empty() ? "(defaults)" : contexts[c].toString())
+                  << " : " << botname << " scored " << means[c] << " +/- " << std::sqrt(variance / games)
+                  << " (" << 100 * (perfectGames / double(games)) << "% perfect)" << std::endl;
+    }
+
+    Hanabi::closeThreadPool();
+    return means;
+}
@@ -0,0 +1,94 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+/* The evaluation harness, shared by the Python extension (hanabi_lib)
+ * and the native `hanabi` executable. None of it needs torch.
+ *
+ * Each of these looks the bots up by their registered names, prints its
+ * report to stdout, and closes the thread pool when done. A seed <= 0
+ * means to pick one (from SLURM_JOBID if set, or else at random). */
+
+/* Play `games` games of botname against itself, and report the scores.
+ * With jobs == 0 the games are played one after another on one server,
+ * as they always have been; with jobs > 0, each game is seeded from the
+ * seed and its index and played on one of `jobs` threads, so the results
+ * don't depend on jobs. If given, every game is recorded to record_path
+ * (see GameRecord.h) and its metrics written to metrics_path (see Metrics.h). */
+void eval_bot(
+  std::string botname,
+  int players,
+  int games,
+  int log_every,
+  int seed,
+  int jobs,
+  std::string record_path,
+  std::string metrics_path
+);
+
+/* Play just the listed games of an evaluation seeded with `seed`, each
+ * exactly as eval_bot would play it with jobs > 0, appending a line to
+ * results_path as each game finishes. A shard of a larger evaluation
+ * passes its own share of the game indices, less any that its results
+ * file shows were already played; see eval_shards.py. */
+void eval_games(
+  std::string botname,
+  int players,
+  int seed,
+  std::vector<int> games,
+  std::string results_path,
+  int jobs
+);
+
+/* Play botA and botB on the same decks, one deck per game, and report
+ * the paired differences in score. Pairing cancels out most of the
+ * deck-to-deck variance, so far fewer games are needed to tell two
+ * bots apart than when comparing two independent evaluations. */
+void eval_paired(
+  std::string botA,
+  std::string botB,
+  int players,
+  int games,
+  int log_every,
+  int seed,
+  int jobs
+);
+
+/* Play every assignment of the given bots to the seats of a game (all
+ * botnames.size()^players of them) on the same set of decks, and report
+ * the average score of each lineup. Returns the cross-play matrix, whose
+ * entry [a][b] is the average score when bot a sits in seat 0 and bot b
+ * in seat 1, over all games and all the bots in the other seats; with two
+ * players, that is just the lineup (a, b). If csv_path is given, the
+ * matrix is also written there. */
+std::vector<std::vector<double>> eval_tournament(
+  std::vector<std::string> botnames,
+  int players,
+  int games,
+  int seed,
+  int jobs,
+  std::string csv_path
+);
+
+/* Play botname under each of several sets of parameters (each overriding
+ * the environment, as in Params::Context), on the same decks and in this
+ * one process, and report the average score under each. Only bots that
+ * take their parameters from a Params::Context (e.g. SearchBot, whose
+ * SEARCH_N, UCB, PARTNER_UNIFORM_UNC and so on are in SearchBotParams)
+ * can differ between configurations. Returns the average scores. */
+std::vector<double> eval_sweep(
+  std::string botname,
+  std::vector<std::map<std::string, std::string>> configs,
+  int players,
+  int games,
+  int seed,
+  int jobs
+);
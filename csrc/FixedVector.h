@@ -0,0 +1,113 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+
+#ifndef H_FIXED_VECTOR
+#define H_FIXED_VECTOR
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+namespace Hanabi {
+
+/* A vector with a fixed capacity whose elements are stored inline.
+ * If T is trivially copyable then so is FixedVector<T, N>, which means
+ * that copying one is a memcpy and never touches the heap.
+ * Only the first size() elements are meaningful; the rest are garbage. */
+template<typename T, int N>
+class FixedVector {
+public:
+    typedef T value_type;
+    typedef T *iterator;
+    typedef const T *const_iterator;
+
+    FixedVector() : size_(0) { }
+    FixedVector(int n, const T &value) : size_(0) { assign(n, value); }
+    FixedVector(std::initializer_list<T> il) : size_(0) { assign(il.begin(), il.end()); }
+    template<class It>
+    FixedVector(It first, It last) : size_(0) { assign(first, last); }
+
+    static constexpr int capacity() { return N; }
+    int size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    bool full() const { return size_ == N; }
+
+    T &operator[](int i) { assert(0 <= i && i < size_); return data_[i]; }
+    const T &operator[](int i) const { assert(0 <= i && i < size_); return data_[i]; }
+    T &front() { assert(size_ > 0); return data_[0]; }
+    const T &front() const { assert(size_ > 0); return data_[0]; }
+    T &back() { assert(size_ > 0); return data_[size_ - 1]; }
+    const T &back() const { assert(size_ > 0); return data_[size_ - 1]; }
+    T *data() { return data_; }
+    const T *data() const { return data_; }
+
+    iterator begin() { return data_; }
+    iterator end() { return data_ + size_; }
+    const_iterator begin() const { return data_; }
+    const_iterator end() const { return data_ + size_; }
+
+    void clear() { size_ = 0; }
+    void push_back(const T &value) { assert(size_ < N); data_[size_++] = value; }
+    void pop_back() { assert(size_ > 0); --size_; }
+    void resize(int n, const T &value) {
+        assert(0 <= n && n <= N);
+        for (int i = size_; i < n; ++i) data_[i] = value;
+        size_ = n;
+    }
+    void assign(int n, const T &value) { size_ = 0; resize(n, value); }
+    template<class It>
+    void assign(It first, It last) {
+        size_ = 0;
+        for (; first != last; ++first) push_back(*first);
+    }
+
+    /* Inserts value before pos, shifting the later elements up. */
+    iterator insert(const_iterator pos, const T &value) {
+        assert(begin() <= pos && pos <= end() && size_ < N);
+        T *p = data_ + (pos - data_);
+        for (T *q = end(); q != p; --q) *q = *(q - 1);
+        *p = value;
+        ++size_;
+        return p;
+    }
+
+    /* Removes the element at pos, shifting the later elements down. */
+    iterator erase(const_iterator pos) {
+        assert(begin() <= pos && pos < end());
+        T *p = data_ + (pos - data_);
+        for (T *q = p + 1; q != end(); ++q) *(q - 1) = *q;
+        --size_;
+        return p;
+    }
+
+    /* Convenience for APIs that still traffic in std::vector. */
+    operator std::vector<T>() const { return std::vector<T>(begin(), end()); }
+
+    bool operator==(const FixedVector &rhs) const {
+        if (size_ != rhs.size_) return false;
+        for (int i = 0; i < size_; ++i) {
+            if (!(data_[i] == rhs.data_[i])) return false;
+        }
+        return true;
+    }
+    bool operator!=(const FixedVector &rhs) const { return !(*this == rhs); }
+
+private:
+    T data_[N];
+    int8_t size_;
+};
+
+/* Lexicographic, like std::vector. */
+template<typename T, int N>
+inline bool operator<(const FixedVector<T, N> &lhs, const FixedVector<T, N> &rhs) {
+    return std::lexicographical_compare(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+}
+
+}  /* namespace Hanabi */
+
+#endif /* H_FIXED_VECTOR */
@@ -0,0 +1,266 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+
+#include <cassert>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <zlib.h>
+#include "Hanabi.h"
+#include "GameRecord.h"
+
+namespace Hanabi {
+
+static const uint8_t RECORD_MAGIC = 'H';
+static const uint8_t RECORD_VERSION = 1;
+
+std::string RecordedMove::toString() const
+{
+    static const char *colornames[] = { "red", "orange", "yellow", "green", "blue" };
+    switch (type) {
+        case PLAY: return "Play " + std::to_string(value);
+        case DISCARD: return "Discard " + std::to_string(value);
+        case COLOR_HINT: return std::string("Hint ") + colornames[value] + " to player " + std::to_string(to);
+        case VALUE_HINT: return "Hint " + std::to_string(value) + " to player " + std::to_string(to);
+    }
+    return "ERROR";
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////    GameRecord    ////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+void GameRecord::appendTo(std::string &bytes) const
+{
+    assert(deck.size() <= DECKSIZE && moves.size() <= 0xffff);
+    bytes.push_back(RECORD_MAGIC);
+    bytes.push_back(RECORD_VERSION);
+    bytes.push_back(numPlayers);
+    bytes.push_back(handSize);
+    for (int i=0; i < 4; ++i) bytes.push_back((seed >> (8 * i)) & 0xff);
+    bytes.push_back(deck.size());
+    for (const Card &card : deck) bytes.push_back(card.index());
+    bytes.push_back(moves.size() & 0xff);
+    bytes.push_back(moves.size() >> 8);
+    for (const RecordedMove &move : moves) bytes.push_back(move.encode());
+    bytes.push_back(score);
+    bytes.push_back(mulligansUsed);
+}
+
+GameRecord GameRecord::parse(const std::string &bytes, size_t &pos)
+{
+    auto next = [&]() -> uint8_t {
+        if (pos >= bytes.size()) throw std::runtime_error("truncated game record");
+        return bytes[pos++];
+    };
+    if (next() != RECORD_MAGIC) throw std::runtime_error("not a game record");
+    if (next() != RECORD_VERSION) throw std::runtime_error("unknown game record version");
+
+    GameRecord record;
+    record.numPlayers = next();
+    record.handSize = next();
+    record.seed = 0;
+    for (int i=0; i < 4; ++i) record.seed |= (uint32_t)next() << (8 * i);
+    const int deckSize = next();
+    for (int i=0; i < deckSize; ++i) {
+        const int index = next();
+        if (index >= NUMCARDTYPES) throw std::runtime_error("bad card in game record");
+        record.deck.push_back(Card(Color(index / VALUE_MAX), index % VALUE_MAX + ONE));
+    }
+    int numMoves = next();
+    numMoves |= next() << 8;
+    for (int i=0; i < numMoves; ++i) {
+        record.moves.push_back(RecordedMove::decode(next()));
+    }
+    record.score = (int8_t)next();
+    record.mulligansUsed = (int8_t)next();
+    return record;
+}
+
+GameRecordWriter::GameRecordWriter(const std::string &path)
+{
+    file_ = gzopen(path.c_str(), "wb");
+    if (file_ == nullptr) throw std::runtime_error("can't open " + path + " for writing");
+}
+
+GameRecordWriter::~GameRecordWriter()
+{
+    gzclose((gzFile)file_);
+}
+
+void GameRecordWriter::write(const GameRecord &record)
+{
+    std::string bytes;
+    record.appendTo(bytes);
+    if (gzwrite((gzFile)file_, bytes.data(), bytes.size()) != (int)bytes.size()) {
+        throw std::runtime_error("failed to write game record");
+    }
+}
+
+std::vector<GameRecord> readGameRecords(const std::string &path)
+{
+    gzFile file = gzopen(path.c_str(), "rb");
+    if (file == nullptr) throw std::runtime_error("can't open " + path);
+    std::string bytes;
+    char buffer[1 << 16];
+    int n;
+    while ((n = gzread(file, buffer, sizeof buffer)) > 0) {
+        bytes.append(buffer, n);
+    }
+    gzclose(file);
+    if (n < 0) throw std::runtime_error("failed to read " + path);
+
+    std::vector<GameRecord> records;
+    size_t pos = 0;
+    while (pos < bytes.size()) {
+        records.push_back(GameRecord::parse(bytes, pos));
+    }
+    return records;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////    GameReplay    ////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+/* Sits in one seat of a replayed game. When it's asked to move, it
+ * makes the recorded move; everything else it passes on to the
+ * observer for its seat, if there is one. */
+struct GameReplay::Spectator final : public Bot {
+    GameReplay *replay;
+    int seat;
+    std::shared_ptr<BotFactory> factory;
+    Bot *observer;
+
+    Spectator(GameReplay *replay, int seat) : replay(replay), seat(seat), observer(nullptr) {}
+    ~Spectator() override { this->remakeObserver(nullptr); }
+
+    /* Replaces the observer with a new one from factory, or with none. */
+    void remakeObserver(std::shared_ptr<BotFactory> newFactory) {
+        if (observer) factory->destroy(observer);
+        observer = nullptr;
+        factory = std::move(newFactory);
+        if (factory) observer = factory->create(seat, replay->numPlayers(), replay->handSize());
+    }
+
+    void pleaseObserveBeforeMove(const Server &server) override {
+        if (observer) observer->pleaseObserveBeforeMove(server);
+    }
+    void pleaseMakeMove(Server &) override {
+        replay->makeRecordedMove_();
+    }
+    void pleaseObserveBeforeDiscard(const Server &server, int from, int card_index) override {
+        if (observer) observer->pleaseObserveBeforeDiscard(server, from, card_index);
+    }
+    void pleaseObserveBeforePlay(const Server &server, int from, int card_index) override {
+        if (observer) observer->pleaseObserveBeforePlay(server, from, card_index);
+    }
+    void pleaseObserveColorHint(const Server &server, int from, int to, Color color, CardIndices card_indices) override {
+        if (observer) observer->pleaseObserveColorHint(server, from, to, color, card_indices);
+    }
+    void pleaseObserveValueHint(const Server &server, int from, int to, Value value, CardIndices card_indices) override {
+        if (observer) observer->pleaseObserveValueHint(server, from, to, value, card_indices);
+    }
+    void pleaseObserveAfterMove(const Server &server) override {
+        if (observer) observer->pleaseObserveAfterMove(server);
+    }
+};
+
+GameReplay::GameReplay(const GameRecord &record) : record_(record), viewer_(0)
+{
+    state_.numPlayers = record.numPlayers;
+    if (this->handSize() != record.handSize) {
+        throw ServerError("game was recorded with a different hand size; check HAND_SIZE_OVERRIDE");
+    }
+    for (int i=0; i < record.numPlayers; ++i) {
+        spectators_.emplace_back(new Spectator(this, i));
+        players_.push_back(spectators_.back().get());
+    }
+    this->srand(record.seed);
+    this->deal_(record.deck);
+    observingPlayer_ = viewer_;
+}
+
+GameReplay::~GameReplay() { }
+
+const RecordedMove &GameReplay::nextMove() const
+{
+    if (this->turn() >= this->numMoves()) throw ServerError("no moves left to replay");
+    return record_.moves[this->turn()];
+}
+
+void GameReplay::step()
+{
+    if (this->turn() >= this->numMoves()) throw ServerError("no moves left to replay");
+    checkpoints_.push_back(this->checkpoint());
+    this->playTurn_<false>();
+    observingPlayer_ = viewer_;
+}
+
+void GameReplay::seek(int turn)
+{
+    if (turn < 0 || turn > this->numMoves()) throw ServerError("no such turn in this game");
+    if (turn < this->turn() && this->hasObservers_()) {
+        this->replayFromStart_(turn);
+        return;
+    }
+    if (turn < this->turn()) {
+        this->rollbackTo(checkpoints_[turn]);
+        checkpoints_.resize(turn);
+        observingPlayer_ = viewer_;
+    }
+    while (this->turn() < turn) this->step();
+}
+
+void GameReplay::setObservingPlayer(int player)
+{
+    if (player < 0 || player >= this->numPlayers()) throw ServerError("player index out of bounds");
+    viewer_ = observingPlayer_ = player;
+}
+
+void GameReplay::setObserver(int seat, std::shared_ptr<BotFactory> factory)
+{
+    if (seat < 0 || seat >= this->numPlayers()) throw ServerError("player index out of bounds");
+    spectators_[seat]->remakeObserver(nullptr);
+    spectators_[seat]->factory = std::move(factory);
+    this->replayFromStart_(this->turn());
+}
+
+bool GameReplay::hasObservers_() const
+{
+    for (const auto &spectator : spectators_) {
+        if (spectator->factory) return true;
+    }
+    return false;
+}
+
+/* Goes back to turn 0, gives every seat a fresh observer (from the same
+ * factory as before), and replays the game to them up to turn. */
+void GameReplay::replayFromStart_(int turn)
+{
+    if (this->turn() > 0) {
+        this->rollbackTo(checkpoints_[0]);
+        checkpoints_.clear();
+        observingPlayer_ = viewer_;
+    }
+    for (auto &spectator : spectators_) {
+        spectator->remakeObserver(spectator->factory);
+    }
+    while (this->turn() < turn) this->step();
+}
+
+void GameReplay::makeRecordedMove_()
+{
+    /* step() has already taken the checkpoint for this move. */
+    const RecordedMove &move = record_.moves[this->turn() - 1];
+    switch (move.type) {
+        case RecordedMove::PLAY: this->pleasePlay(move.value); break;
+        case RecordedMove::DISCARD: this->pleaseDiscard(move.value); break;
+        case RecordedMove::COLOR_HINT: this->pleaseGiveColorHint(move.to, Color(move.value)); break;
+        case RecordedMove::VALUE_HINT: this->pleaseGiveValueHint(move.to, Value(move.value)); break;
+    }
+}
+
+}  /* namespace Hanabi */
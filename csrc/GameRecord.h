@@ -0,0 +1,111 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+
+#pragma once
+
+#include "Hanabi.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Hanabi {
+
+/* One move, as the active player asked the server to make it. */
+struct RecordedMove {
+    enum Type : uint8_t { PLAY, DISCARD, COLOR_HINT, VALUE_HINT };
+    Type type;
+    int8_t to;  /* the player hinted; 0 for plays and discards */
+    int8_t value;  /* the card index, the Color or the Value */
+
+    /* A move fits in one byte: 2 bits of type, 3 of player, 3 of value. */
+    uint8_t encode() const { return (type << 6) | (to << 3) | value; }
+    static RecordedMove decode(uint8_t byte) {
+        RecordedMove move = { Type(byte >> 6), int8_t((byte >> 3) & 0x7), int8_t(byte & 0x7) };
+        return move;
+    }
+    std::string toString() const;
+};
+
+/* Everything needed to replay a game exactly: the deck as it was
+ * stacked, and every move made. A server fills one of these in if
+ * given one with Server::setRecord(). */
+struct GameRecord {
+    uint32_t seed;
+    int numPlayers;
+    int handSize;
+    std::vector<Card> deck;  /* in drawing order; a stackedDeck for runGame */
+    std::vector<RecordedMove> moves;
+    int score;
+    int mulligansUsed;
+
+    /* The binary format, uncompressed. Each record is a few dozen bytes:
+     *   'H', version, numPlayers, handSize, seed (4 bytes, little-endian),
+     *   deck size, one Card::index() per card, move count (2 bytes),
+     *   one encoded move per move, score, mulligansUsed. */
+    void appendTo(std::string &bytes) const;
+    /* Parses the record starting at bytes[pos], and advances pos past it.
+     * Throws std::runtime_error if the bytes aren't a valid record. */
+    static GameRecord parse(const std::string &bytes, size_t &pos);
+};
+
+/* Appends game records to a gzip-compressed file. */
+class GameRecordWriter {
+public:
+    explicit GameRecordWriter(const std::string &path);
+    ~GameRecordWriter();
+    void write(const GameRecord &record);
+private:
+    void *file_;  /* a gzFile; void* to keep zlib.h out of this header */
+};
+
+/* Reads back every record in a file written by GameRecordWriter. */
+std::vector<GameRecord> readGameRecords(const std::string &path);
+
+/* Replays a recorded game, without any bots. seek(turn) puts the server
+ * in the state just before move number turn, where 0 <= turn <= numMoves().
+ * It goes forward by making the recorded moves, and back by rolling
+ * them back, so stepping around even a long game costs next to nothing.
+ *
+ * An observer may be attached to any seat. It then receives every
+ * observer callback that the bot in that seat received as the game was
+ * played; but it is never asked to move. This is enough to bring a bot
+ * up to any turn of a game, to see what it would do there. Bots can't be
+ * rolled back, so seeking backward with an observer attached remakes
+ * the observers and replays the game to them from the start. */
+class GameReplay : public Server {
+public:
+    explicit GameReplay(const GameRecord &record);
+    ~GameReplay() override;
+
+    int numMoves() const { return (int)record_.moves.size(); }
+    int turn() const { return (int)checkpoints_.size(); }
+    /* The move about to be made; turn() must be less than numMoves(). */
+    const RecordedMove &nextMove() const;
+
+    void step();
+    void seek(int turn);
+
+    /* Choose whose point of view the accessors take (see whoAmI()). */
+    void setObservingPlayer(int player);
+    /* Make an observer for seat with factory (or, if factory is null,
+     * have none there), and bring it up to the current turn by
+     * replaying the game to it from the start. */
+    void setObserver(int seat, std::shared_ptr<BotFactory> factory);
+
+private:
+    struct Spectator;
+    GameRecord record_;
+    int viewer_;
+    std::vector<std::unique_ptr<Spectator>> spectators_;
+    std::vector<Checkpoint> checkpoints_;  /* one per move made */
+
+    void makeRecordedMove_(void);
+    bool hasObservers_() const;
+    void replayFromStart_(int turn);
+};
+
+}  /* namespace Hanabi */
@@ -7,12 +7,18 @@
 #ifndef H_HANABI_SERVER
 #define H_HANABI_SERVER
 
+#include <array>
 #include <cassert>
+#include <map>
+#include <mutex>
 #include <string>
 #include <ostream>
 #include <random>
+#include <set>
 #include <vector>
 #include <tuple>
+#include <type_traits>
+#include "FixedVector.h"
 #include "ThreadPool.h"
 #include <future>
 
@@ -33,6 +39,60 @@ namespace Params {
     float default_val,
     const std::string help=""
   );
+  /* Change the process-wide value of a parameter, as if it had been
+   * set in the environment. Bots read their parameters when they're
+   * created, so this takes effect from the next game. */
+  void setParameter(const std::string &name, const std::string &value);
+
+  /* A set of parameter values that take precedence over the process-wide
+   * ones, so that bots in different games of the same process can run
+   * with different parameters. A parameter the context doesn't set falls
+   * back to getParameter*(), i.e. to the environment. */
+  class Context {
+  public:
+    Context() { }
+    explicit Context(const std::map<std::string, std::string> &values) : values_(values) { }
+    void set(const std::string &name, const std::string &value) { values_[name] = value; }
+    const std::map<std::string, std::string> &values() const { return values_; }
+    std::string toString() const;  /* "NAME=value,NAME=value" */
+
+    std::string getString(const std::string &name, std::string default_val, const std::string help="") const;
+    int getInt(const std::string &name, int default_val, const std::string help="") const;
+    float getFloat(const std::string &name, float default_val, const std::string help="") const;
+
+    /* The context in effect on this thread; see Scope. */
+    static const Context &current();
+  private:
+    std::map<std::string, std::string> values_;
+  };
+
+  /* Puts a context in effect on this thread for as long as it lives. */
+  class Scope {
+  public:
+    explicit Scope(const Context &context);
+    ~Scope();
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+  private:
+    const Context *previous_;
+  };
+
+  /* Notes the name of every parameter read on this thread for as long as
+   * it lives, from a context or not; e.g. to find out which parameters a
+   * bot reads when it's created. */
+  class Recorder {
+  public:
+    Recorder();
+    ~Recorder();
+    Recorder(const Recorder &) = delete;
+    Recorder &operator=(const Recorder &) = delete;
+    const std::set<std::string> &names() const { return names_; }
+    /* Notes that name was read, if a recorder is alive on this thread. */
+    static void note(const std::string &name);
+  private:
+    Recorder *previous_;
+    std::set<std::string> names_;
+  };
 }
 
 namespace HanabiParams {
@@ -49,7 +109,7 @@ namespace HanabiParams {
     "Number of user-space threads (i.e. fibers) to use for search (i.e. max parallelism). "
     "These fibers are run on the fiber thread pool defined by FIBER_THREADS");
   const int HAND_SIZE_OVERRIDE = Params::getParameterInt("HAND_SIZE_OVERRIDE", -1,
-    "If >0, this overrides the hand size. Must be >= 3.");
+    "If >=0, this overrides the hand size. Must be from 3 to 5 (MAXHANDSIZE).");
 } // namespace HanabiParams
 
 
@@ -59,16 +119,53 @@ namespace Hanabi {
     class Server;
     class Bot;
     class BotFactory;
+    struct GameRecord;
 }  /* namespace Hanabi */
 
 namespace Hanabi {
 
+/* The pool that runs search fibers, and the lock that lets game threads
+ * (eval_bot --jobs) ask for it at the same time. A pool that has been
+ * replaced is kept, so that a reference to it never dangles, and so that
+ * no new pool can have its address. */
+struct ThreadPoolSlot {
+  std::mutex mutex;
+  std::shared_ptr<ThreadPool> pool;
+  std::vector<std::shared_ptr<ThreadPool>> closed;
+};
+
+inline ThreadPoolSlot &threadPoolSlot_() {
+  static ThreadPoolSlot &slot = *new ThreadPoolSlot();
+  return slot;
+}
+
+/* The pool that runs search fibers. It can be made ahead of time (see
+ * warmUp) on a different thread from the games that use it: each thread
+ * joins the pool's work-sharing scheduler the first time it asks for it,
+ * and again if the pool has been closed and replaced since.
+ * A pool that is still open at exit is left to die with the process,
+ * since by then this thread's fiber scheduler is gone and it can't be
+ * closed. */
 inline ThreadPool &getThreadPool() {
-  static std::shared_ptr<ThreadPool> pool;
-  if (!pool || pool->stop) {
-    pool.reset(new ThreadPool(HanabiParams::FIBER_THREADS));
+  ThreadPoolSlot &slot = threadPoolSlot_();
+  static thread_local const ThreadPool *joined = nullptr;
+  std::lock_guard<std::mutex> lock(slot.mutex);
+  if (!slot.pool || slot.pool->stop) {
+    if (slot.pool) slot.closed.push_back(std::move(slot.pool));
+    slot.pool.reset(new ThreadPool(HanabiParams::FIBER_THREADS));  /* joins it */
+  } else if (joined != slot.pool.get()) {
+    boost::fibers::use_scheduling_algorithm< boost::fibers::algo::shared_work >(true);
   }
-  return *pool;
+  joined = slot.pool.get();
+  return *slot.pool;
+}
+
+/* Closes the pool, if one was made and is still open; unlike
+ * getThreadPool().close(), this doesn't make a pool just to close it. */
+inline void closeThreadPool() {
+  ThreadPoolSlot &slot = threadPoolSlot_();
+  std::lock_guard<std::mutex> lock(slot.mutex);
+  if (slot.pool && !slot.pool->stop) slot.pool->close();
 }
 
 class ServerError : public std::runtime_error {
@@ -84,9 +181,17 @@ constexpr int NUMCOLORS = 5;
 typedef enum : int8_t { ONE=1, TWO, THREE, FOUR, FIVE } Value;
 constexpr int VALUE_MAX=5;
 
+/* The number of distinct (color, value) pairs; see Card::index(). */
+constexpr int NUMCARDTYPES = NUMCOLORS * VALUE_MAX;
+
 constexpr int NUMHINTS = 8;
 constexpr int NUMMULLIGANS = 3;
 
+/* Upper bounds used to size the fixed-capacity game state. */
+constexpr int MAXPLAYERS = 5;
+constexpr int MAXHANDSIZE = 5;
+constexpr int DECKSIZE = 50;
+
 inline Color &operator++ (Color &c) { c = Color((int)c+1); return c; }
 inline Color operator++ (Color &c, int) { Color oc = c; ++c; return oc; }
 inline Value &operator++ (Value &v) { v = Value((int)v+1); return v; }
@@ -98,13 +203,13 @@ class Card {
 public:
     Color color;
     Value value;
-  #ifdef CARD_ID
-    int16_t id; // just for keeping track of cards in hand for UI
-  #endif
+    Card() = default;  /* uninitialized; only for fixed-capacity storage */
     Card(Color c, Value v);
     Card(Color c, int v);
     int count() const;
     std::string toString() const;
+    /* A dense index in 0..NUMCARDTYPES-1, in the same order as operator<. */
+    int index() const { return (int)color * VALUE_MAX + ((int)value - ONE); }
 
     bool operator== (const Card &rhs) const
     { return (this->color == rhs.color) && (this->value == rhs.value); }
@@ -124,7 +229,7 @@ class Pile {
 private:
     Color color;
     int size_;  /* might be zero */
-    void increment_();
+    Pile(Color c, int size) : color(c), size_(size) { }
     friend class Server;
 public:
     bool empty() const { return size_ == 0; }
@@ -161,6 +266,62 @@ public:
     bool empty() const { return (mask_ == 0); }
 };
 
+static_assert(sizeof(Card) == 2, "Card must stay two bytes");
+
+typedef FixedVector<Card, MAXHANDSIZE> HandArray;
+/* For the UI: which card of the deck each card in a hand is, in the
+ * same order as the HandArray. Cards are numbered by their position
+ * in the deck as dealt, so the first card drawn has the highest id. */
+typedef FixedVector<int8_t, MAXHANDSIZE> HandIds;
+typedef FixedVector<Card, DECKSIZE> DeckArray;
+/* A number of copies of each card, indexed by Card::index(). */
+typedef std::array<int8_t, NUMCARDTYPES> CardCounts;
+
+/* Facts about the cards that follow from the piles and the discards
+ * alone, so they are the same for every observer. The server refreshes
+ * them whenever a card is played or discarded; bots that need them
+ * should read them from Server::derivedFacts() rather than working them
+ * out again for themselves. The sets are bitmasks indexed by Card::index().
+ * Packed, so that GameState doesn't carry three bytes of padding after it. */
+struct __attribute__((packed)) DerivedFacts {
+    uint32_t playable;  /* would go onto its pile right now */
+    uint32_t dead;  /* can never score: already played, or some lower card of its color is gone */
+    uint32_t critical;  /* can still score, and this is the last copy of it */
+    int8_t maxScore;  /* the best score still reachable, ignoring the clock */
+
+    bool isPlayable(Card card) const { return (playable >> card.index()) & 1; }
+    bool isDead(Card card) const { return (dead >> card.index()) & 1; }
+    bool isCritical(Card card) const { return (critical >> card.index()) & 1; }
+};
+
+/* The complete state of a game in progress, minus the bots and the
+ * bookkeeping of whose observer callback is currently running.
+ * This is trivially copyable and just under half a kilobyte (510 bytes,
+ * 400 of them the deck, the discards and the unseen-card counts), so a
+ * server can be forked for a rollout with a single memcpy of eight
+ * cache lines instead of a dozen heap allocations. */
+struct GameState {
+    DeckArray deck;  /* the top of the deck is deck.back() */
+    DeckArray discards;
+    HandArray hands[MAXPLAYERS];
+    HandIds handIds[MAXPLAYERS];
+    int8_t piles[NUMCOLORS];
+    CardCounts unseen;  /* not yet played or discarded */
+    CardCounts unseenBy[MAXPLAYERS];  /* ...and not in anyone else's hand */
+    /* Bitmasks of the cards in each hand that a color (value) hint
+     * would touch; kept up to date whenever a hand changes. */
+    uint8_t colorMasks[MAXPLAYERS][NUMCOLORS];
+    uint8_t valueMasks[MAXPLAYERS][VALUE_MAX];
+    DerivedFacts facts;
+    int8_t numPlayers;
+    int8_t activePlayer;
+    int8_t hintStonesRemaining;
+    int8_t mulligansRemaining;
+    int8_t finalCountdown;
+};
+static_assert(std::is_trivially_copyable<GameState>::value, "GameState must be trivially copyable");
+static_assert(sizeof(GameState) <= 8 * 64, "GameState has outgrown eight cache lines; update its comment");
+
 class Server {
 public:
     Server();
@@ -172,6 +333,10 @@ public:
     /* Seed the random number generator. */
     void srand(unsigned int seed);
 
+    /* Record each game this server runs into record, overwriting
+     * what was there before; see GameRecord.h. Pass null to stop. */
+    void setRecord(GameRecord *record);
+
     /* Set up a new game, using numPlayers player-bots as created
      * by repeated calls to botFactory.create(i,numPlayers). Then
      * run the game to its conclusion, and return the final score. */
@@ -199,6 +364,7 @@ public:
 
     /* Returns the starting hand size for this game. */
     int handSize() const;
+    static int handSizeFor(int numPlayers);
 
     /* Returns the index of the player who is currently
      * querying the server. */
@@ -212,10 +378,16 @@ public:
     /* Returns the number of cards in some player's hand. */
     int sizeOfHandOfPlayer(int player) const;
 
-    /* Returns a vector of the cards in some player's hand.
+    /* Returns the cards in some player's hand.
      * Throws an exception if a player tries to look at his own hand,
      * i.e., server.handOfPlayer(server.whoAmI()). */
-    const std::vector<Card>& handOfPlayer(int player) const;
+    const HandArray& handOfPlayer(int player) const;
+
+    /* Returns the cards in some player's hand that a hint of the given
+     * color (or value) would point out. This is cheap: no hand is scanned.
+     * Throws an exception if a player asks about his own hand. */
+    CardIndices cardsMatchingHint(int player, Color color) const;
+    CardIndices cardsMatchingHint(int player, Value value) const;
 
     /* Convenience method to keep track of card identity across turns */
     const std::vector<int> cardIdsOfHandOfPlayer(int player) const;
@@ -230,13 +402,13 @@ public:
     /* Observe the pile of the given color. */
     Pile pileOf(Color color) const;
 
-    /* Returns a vector of the discards over the whole game.
+    /* Returns the discards over the whole game.
      * The first card ever discarded is v[0]; the latest
      * card discarded is v[v.size()-1].
      * Discards include any cards that were misplayed as a
      * result of a bad pleasePlay(), in addition to any cards
      * that were explicitly discarded with pleaseDiscard(). */
-    const std::vector<Card>& discards() const;
+    const DeckArray& discards() const;
 
     /* Returns the number of hint-stones used (by all players),
      * or the number remaining in the middle of the table.
@@ -257,6 +429,16 @@ public:
     /* Returns the number of cards remaining to be drawn. */
     int cardsRemainingInDeck() const;
 
+    /* Returns how many copies of each card the given player hasn't
+     * seen, i.e., those still in the deck or in his own hand.
+     * If player is -1, also counts the cards in everyone's hands.
+     * These are kept up to date as cards move, so this is cheap. */
+    const CardCounts& unseenCards(int player) const;
+
+    /* Returns the playable, dead and critical cards. These are
+     * computed once per move, not once per bot, so this is cheap. */
+    const DerivedFacts& derivedFacts() const;
+
     int finalCountdown() const;
 
     /* Returns TRUE if no more calls to pleaseMakeMove()
@@ -302,6 +484,28 @@ public:
      * Throws an exception if there are no hint-stones left. */
     virtual void pleaseGiveValueHint(int player, Value value);
 
+    /*================= MAKE/UNMAKE ==========================*/
+
+    /* Everything needed to return the server to an earlier point
+     * in the game; see checkpoint() and rollbackTo(). */
+    struct Checkpoint {
+        int journalSize;
+        int observingPlayer;
+        int movesFromActivePlayer;
+        Card activeCard;
+        bool activeCardIsObservable;
+    };
+
+    /* Start journaling (if we weren't already) and return the current
+     * point in the game. From then on, every move made through the
+     * mutators above, and every change of turn, records an undo entry. */
+    Checkpoint checkpoint();
+
+    /* Undo every move made since the given checkpoint was taken.
+     * Replacement cards go back on top of the deck, so the same
+     * server can be rolled out again and again without copying it. */
+    void rollbackTo(const Checkpoint &checkpoint);
+
     /*================= DEBUGGING TOOLS ======================*/
 
     std::string handsAsString() const;
@@ -309,7 +513,7 @@ public:
     std::string discardsAsString() const;
     /* This exposes any player's hand, including the observing player.
      * This should only be used for debugging purposes! */
-    std::vector<Card> cheatGetHand(int index) const;
+    const HandArray& cheatGetHand(int index) const;
 
     std::ostream* log() {
       return log_;
@@ -320,28 +524,75 @@ public:
 protected:
     /* Administrivia */
     std::ostream *log_;
+    GameRecord *record_;
     std::mt19937 rand_;
     std::vector<Bot *> players_;
     int observingPlayer_;
-    int activePlayer_;
     int movesFromActivePlayer_;
     Card activeCard_;
     bool activeCardIsObservable_;
-    int finalCountdown_;
-    /* Basically-public state */
-    int numPlayers_;
-    Pile piles_[NUMCOLORS];
-    std::vector<Card> discards_;
-    int hintStonesRemaining_;
-    int mulligansRemaining_;
-    /* Basically-hidden state */
-    std::vector<std::vector<Card> > hands_;
-    std::vector<Card> deck_;
+    /* Everything else: piles, stones, hands and deck */
+    GameState state_;
+
+    /* One entry in the undo journal. The counters are as they were
+     * before the move; index is -1 if no card left a hand. */
+    struct UndoEntry {
+        int8_t index;
+        Card card;  /* the card that was played or discarded */
+        int8_t cardId;  /* ...and its id */
+        bool toDiscards;  /* as opposed to onto its pile */
+        bool drew;  /* whether a replacement card was drawn */
+        int8_t activePlayer;
+        int8_t hintStonesRemaining;
+        int8_t mulligansRemaining;
+        int8_t finalCountdown;
+    };
+    bool journaling_;
+    std::vector<UndoEntry> journal_;
+
+    /* Shuffle (or stack) the deck and deal the starting hands. */
+    void deal_(const std::vector<Card>& stackedDeck);
+
+    /* The game loop and the mutators, templated on whether this is a
+     * lean server: one that never logs, and that trusts its bots to
+     * make only legal moves. Server itself is never lean; see
+     * RolloutServer in BotUtils.h. They are also templated on the
+     * number of players and the hand size, so that the observer and
+     * hand loops have a constant trip count. Only the standard shapes
+     * (2/5, 3/5, 4/4 and 5/4) are instantiated; NumPlayers == HandSize
+     * == 0 means "look them up at runtime", for any other shape. */
+    template<bool Lean, int NumPlayers=0, int HandSize=0> int runToCompletion_(void);
+    template<bool Lean, int NumPlayers=0, int HandSize=0> void playTurn_(void);
+    template<bool Lean, int NumPlayers=0, int HandSize=0> void pleaseDiscard_(int index);
+    template<bool Lean, int NumPlayers=0, int HandSize=0> void pleasePlay_(int index);
+    template<bool Lean, int NumPlayers=0, int HandSize=0> void pleaseGiveColorHint_(int to, Color color);
+    template<bool Lean, int NumPlayers=0, int HandSize=0> void pleaseGiveValueHint_(int to, Value value);
+    template<int NumPlayers> int playerCount_(void) const {
+        return (NumPlayers != 0) ? NumPlayers : state_.numPlayers;
+    }
+    /* An upper bound on the size of any hand. */
+    template<int HandSize> static constexpr int handCapacity_(void) {
+        return (HandSize != 0) ? HandSize : MAXHANDSIZE;
+    }
+
+    /* Copy the game state of another server, hiding the information
+     * that the observing player isn't entitled to (their own hand, the
+     * deck and any card they can't currently observe) behind junk cards. */
+    void forkFrom_(const Server &s);
 
     /* Private methods */
+    void pushUndoEntry_(void);
+    void pushUndoEntry_(int index, Card card, bool toDiscards);
+    template<bool Lean, int NumPlayers, int HandSize> void replaceCard_(int index);
+    template<int NumPlayers=0> void advanceTurn_(void);
+    template<int NumPlayers=0> void cardEnteredHand_(int player, Card card);
+    void cardLeftHand_(int player, Card card);
+    template<int HandSize=0> void updateHintMasks_(int player);
+    void updateDerivedFacts_(void);
+    static CardIndices cardIndicesFromMask_(unsigned int mask);
     Card draw_(void);
-    void regainHintStoneIfPossible_(void);
-    void loseMulligan_(void);
+    template<bool Lean> void regainHintStoneIfPossible_(void);
+    template<bool Lean> void loseMulligan_(void);
     void logHands_(void) const;
     void logPiles_(void) const;
 };
@@ -353,6 +604,15 @@ protected:
 
 namespace Hanabi {
 
+/* What a bot can tell the evaluation harness about how it chose its
+ * latest move; -1 means it can't say. See Metrics.h. */
+struct MoveMetrics {
+    long long beliefRangeSize = -1;  /* the number of hands it thought it might hold */
+    long long beliefBytes = -1;  /* the memory its beliefs took up */
+    long long rollouts = -1;  /* the number of search rollouts it ran */
+    int deviated = -1;  /* 1 if search overrode the blueprint's move, else 0 */
+};
+
 class Bot {
 public:
     virtual ~Bot();  /* virtual destructor */
@@ -374,6 +634,15 @@ public:
      * by a partner that violates its assumptions. */
     virtual void setPermissive(bool permissive) { permissive_ = permissive; }
 
+    /* Report on the move just made in pleaseMakeMove(). */
+    virtual MoveMetrics getMoveMetrics() const { return MoveMetrics(); }
+
+    /* Do ahead of time whatever setup all bots of this class share, and
+     * would otherwise do lazily during their first game: loading models,
+     * building tables. ::BotFactory<SpecificBot> calls SpecificBot::warmUp,
+     * so a bot class with such setup hides this with its own. */
+    static void warmUp(int /*numPlayers*/, int /*handSize*/) { }
+
     /* hacks for playing TorchBot with humans */
     virtual const std::map<int, float> &getActionProbs() const {
       throw std::runtime_error("Not implemented.");
@@ -390,13 +659,38 @@ class BotFactory {
 public:
     virtual Bot *create(int index, int numPlayers, int handSize) const = 0;
     virtual void destroy(Bot *bot) const = 0;
+    /* See Bot::warmUp. */
+    virtual void warmUp(int /*numPlayers*/, int /*handSize*/) const { }
     virtual ~BotFactory() = default;
 };
 
+/* Makes the bots of another factory, with a Params::Context in effect
+ * while each is created; bots that read parameters read them then. */
+class ParamsBotFactory final : public BotFactory {
+public:
+    ParamsBotFactory(const BotFactory &factory, const Params::Context &params)
+        : factory_(factory), params_(params) {}
+    Bot *create(int index, int numPlayers, int handSize) const override;
+    void destroy(Bot *bot) const override { factory_.destroy(bot); }
+    void warmUp(int numPlayers, int handSize) const override;
+private:
+    const BotFactory &factory_;
+    Params::Context params_;
+};
+
+/* The deck that a fresh server seeded with seed would shuffle, listed
+ * in the order the cards will be drawn; i.e. a stackedDeck for runGame. */
+std::vector<Card> shuffledDeck(unsigned int seed);
+
 // simple registration of BotFactory's by string key
 void registerBotFactory(std::string name, std::shared_ptr<Hanabi::BotFactory> factory);
 std::shared_ptr<Hanabi::BotFactory> getBotFactory(const std::string &botName);
 
+/* Gets everything ready for the named bot's first game of numPlayers,
+ * so that its first move is no slower than the rest: starts the thread
+ * pool, and warms up the bot's factory. */
+void warmUp(const std::string &botName, int numPlayers);
+
 }  /* namespace Hanabi */
 
 
@@ -6,14 +6,19 @@
 
 #include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <ostream>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <random>
 #include <stdexcept>
 #include <sstream>
 #include <string>
 #include <vector>
 #include "Hanabi.h"
+#include "GameRecord.h"
+#include "Log.h"
 
 #ifdef HANABI_SERVER_NDEBUG
 #define HANABI_SERVER_ASSERT(x, msg) (void)0
@@ -21,19 +26,35 @@
 #define HANABI_SERVER_ASSERT(x, msg) do { if (!(x)) throw ServerError(msg); } while (0)
 #endif
 
+/* A check that a Lean server skips, because its bots only make legal moves. */
+#define HANABI_SERVER_CHECK(x, msg) do { if (!Lean) HANABI_SERVER_ASSERT(x, msg); } while (0)
+
 namespace Params {
 
-std::string getParameterString(const std::string &name, std::string default_val, const std::string help) {
+/* Environment variables, as read; and anything set by setParameter().
+ * Parameters are read during static initialization, so these can't be
+ * plain globals. */
+static std::map<std::string, std::string> &memoizedParameters() {
   static std::map<std::string, std::string> memoized;
+  return memoized;
+}
+static std::mutex &memoizedParametersMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+static thread_local Recorder *currentRecorder = nullptr;
+
+std::string getParameterString(const std::string &name, std::string default_val, const std::string help) {
+  Recorder::note(name);
+  std::lock_guard<std::mutex> lock(memoizedParametersMutex());
+  auto &memoized = memoizedParameters();
   if (memoized.count(name)) {
     return memoized.at(name);
   }
   char *val = getenv(name.c_str());
   std::string ret = (val && std::string(val) != "") ? std::string(val) : default_val;
-  std::cerr << name << ": " << ret << std::endl;
-  if (help != "") {
-    std::cerr << "\t" << help << std::endl;
-  }
+  HANABI_LOG(INFO, Params) << name << ": " << ret << (help != "" ? "\n\t" + help : "");
   memoized[name] = ret;
   return ret;
 }
@@ -48,6 +69,61 @@ float getParameterFloat(const std::string &name, float default_val, const std::s
   return std::stof(val);
 }
 
+void setParameter(const std::string &name, const std::string &value) {
+  std::lock_guard<std::mutex> lock(memoizedParametersMutex());
+  memoizedParameters()[name] = value;
+}
+
+std::string Context::toString() const {
+  std::string result;
+  for (const auto &kv : values_) {
+    if (!result.empty()) result += ",";
+    result += kv.first + "=" + kv.second;
+  }
+  return result;
+}
+
+std::string Context::getString(const std::string &name, std::string default_val, const std::string help) const {
+  Recorder::note(name);
+  auto it = values_.find(name);
+  return (it != values_.end()) ? it->second : getParameterString(name, default_val, help);
+}
+
+int Context::getInt(const std::string &name, int default_val, const std::string help) const {
+  return stoi(this->getString(name, std::to_string(default_val), help));
+}
+
+float Context::getFloat(const std::string &name, float default_val, const std::string help) const {
+  return std::stof(this->getString(name, std::to_string(default_val), help));
+}
+
+static thread_local const Context *currentContext = nullptr;
+
+const Context &Context::current() {
+  static const Context empty;
+  return currentContext ? *currentContext : empty;
+}
+
+Scope::Scope(const Context &context) : previous_(currentContext) {
+  currentContext = &context;
+}
+
+Scope::~Scope() {
+  currentContext = previous_;
+}
+
+Recorder::Recorder() : previous_(currentRecorder) {
+  currentRecorder = this;
+}
+
+Recorder::~Recorder() {
+  currentRecorder = previous_;
+}
+
+void Recorder::note(const std::string &name) {
+  if (currentRecorder) currentRecorder->names_.insert(name);
+}
+
 }
 
 
@@ -138,24 +214,18 @@ Card Pile::topCard() const
     return Card(color, size_);
 }
 
-void Pile::increment_()
-{
-    assert(0 <= size_ && size_ <= 4);
-    ++size_;
-}
-
 /* virtual destructor */
 Bot::~Bot() { }
 
 /* Hanabi::Card has no default constructor */
-Server::Server(): log_(nullptr), activeCard_(RED,1) { }
+Server::Server(): log_(nullptr), record_(nullptr), activeCard_(RED,1), journaling_(false) { }
 
 bool Server::gameOver() const
 {
     /* The game ends if there are no more cards to draw... */
-    if (this->deck_.empty() && finalCountdown_ == numPlayers_+1) return true;
+    if (state_.deck.empty() && state_.finalCountdown == state_.numPlayers+1) return true;
     /* ...no more mulligans available... */
-    if (this->mulligansRemaining_ == 0) return true;
+    if (state_.mulligansRemaining == 0) return true;
     /* ...or if the piles are all complete. */
     if (this->currentScore() == 5*NUMCOLORS) return true;
     /* Otherwise, the game has not ended. */
@@ -164,19 +234,16 @@ bool Server::gameOver() const
 
 int Server::currentScore() const
 {
-    if(mulligansRemaining_ == 0 && BOMB0) {
+    if(state_.mulligansRemaining == 0 && BOMB0) {
       return 0;
     }
 
     int sum = 0;
     for (int color = 0; color < NUMCOLORS; ++color) {
-        const Pile &pile = this->piles_[color];
-        if (!pile.empty()) {
-            sum += pile.topCard().value;
-        }
+        sum += state_.piles[color];
     }
     // add a little penalty to discouurage mulligans based on equivalent choices
-    if (mulligansRemaining_ == 0) {
+    if (state_.mulligansRemaining == 0) {
       sum = std::max(sum - BOMBD, 0);
     }
     return sum;
@@ -193,6 +260,11 @@ void Server::srand(unsigned int seed)
     this->rand_.seed(seed);
 }
 
+void Server::setRecord(GameRecord *record)
+{
+    this->record_ = record;
+}
+
 template<class It, class Gen>
 static void portable_shuffle(It first, It last, Gen& g)
 {
@@ -206,6 +278,22 @@ static void portable_shuffle(It first, It last, Gen& g)
     }
 }
 
+std::vector<Card> shuffledDeck(unsigned int seed)
+{
+    std::mt19937 rand(seed);
+    std::vector<Card> deck;
+    for (Color color = RED; color <= BLUE; ++color) {
+        for (int value = 1; value <= 5; ++value) {
+            const Card card(color, value);
+            const int n = card.count();
+            for (int k=0; k < n; ++k) deck.push_back(card);
+        }
+    }
+    portable_shuffle(deck.begin(), deck.end(), rand);
+    std::reverse(deck.begin(), deck.end());  /* a server draws from the back */
+    return deck;
+}
+
 int Server::runGame(const BotFactory &botFactory, int numPlayers)
 {
     return this->runGame(botFactory, numPlayers, std::vector<Card>());
@@ -213,7 +301,7 @@ int Server::runGame(const BotFactory &botFactory, int numPlayers)
 
 int Server::runGame(const BotFactory &botFactory, int numPlayers, const std::vector<Card>& stackedDeck)
 {
-  numPlayers_ = numPlayers;
+  state_.numPlayers = numPlayers;
   std::vector<Bot*> players(numPlayers);
   for (int i=0; i < numPlayers; ++i) {
       players[i] = botFactory.create(i, numPlayers, handSize());
@@ -227,142 +315,193 @@ int Server::runGame(const BotFactory &botFactory, int numPlayers, const std::vec
 
 int Server::runGame(std::vector<Bot*> players, const std::vector<Card>& stackedDeck)
 {
-    std::cerr << "Starting game..." << std::endl;
+    HANABI_LOG(DEBUG, Server) << "Starting game...";
     /* Create and initialize the bots. */
     players_ = players;
-    numPlayers_ = players.size();
+    HANABI_SERVER_ASSERT(players.size() <= MAXPLAYERS, "too many players");
+    state_.numPlayers = players.size();
+    this->deal_(stackedDeck);
+
+    /* Run the game. */
+    int score = this->runToCompletion();
+    if (record_) {
+        record_->score = score;
+        record_->mulligansUsed = this->mulligansUsed();
+    }
+
+    return score;
+}
+
+void Server::deal_(const std::vector<Card>& stackedDeck)
+{
     const int initialHandSize = this->handSize();
+    HANABI_SERVER_ASSERT(initialHandSize <= MAXHANDSIZE, "hand size too large");
 
     /* Initialize the piles and stones. */
     for (Color color = RED; color <= BLUE; ++color) {
-        piles_[(int)color].color = color;
-        piles_[(int)color].size_ = 0;
+        state_.piles[(int)color] = 0;
     }
-    mulligansRemaining_ = NUMMULLIGANS;
-    hintStonesRemaining_ = NUMHINTS;
-    finalCountdown_ = 0;
+    state_.mulligansRemaining = NUMMULLIGANS;
+    state_.hintStonesRemaining = NUMHINTS;
+    state_.finalCountdown = 0;
 
     /* Shuffle the deck. */
     if (!stackedDeck.empty()) {
-        deck_ = stackedDeck;
-        std::reverse(deck_.begin(), deck_.end());  /* because we pull cards from the "top" (back) of the vector */
+        state_.deck.assign(stackedDeck.rbegin(), stackedDeck.rend());  /* because we pull cards from the "top" (back) of the deck */
     } else {
-        deck_.clear();
+        state_.deck.clear();
         for (Color color = RED; color <= BLUE; ++color) {
             for (int value = 1; value <= 5; ++value) {
                 const Card card(color, value);
                 const int n = card.count();
-                for (int k=0; k < n; ++k) deck_.push_back(card);
+                for (int k=0; k < n; ++k) state_.deck.push_back(card);
             }
         }
-        portable_shuffle(deck_.begin(), deck_.end(), rand_);
+        portable_shuffle(state_.deck.begin(), state_.deck.end(), rand_);
     }
-#ifdef CARD_ID
-    int id_count = 0;
-    for (auto &card: deck_) {
-      card.id = id_count++;
+    state_.discards.clear();
+    if (record_) {
+        record_->seed = seed_;
+        record_->numPlayers = state_.numPlayers;
+        record_->handSize = initialHandSize;
+        record_->deck.assign(state_.deck.begin(), state_.deck.end());
+        std::reverse(record_->deck.begin(), record_->deck.end());  /* into drawing order */
+        record_->moves.clear();
+        record_->score = record_->mulligansUsed = -1;
+    }
+
+    /* Nobody has seen anything yet. */
+    for (int i=0; i < NUMCARDTYPES; ++i) {
+        const Card card((Color)(i / VALUE_MAX), i % VALUE_MAX + ONE);
+        state_.unseen[i] = card.count();
+    }
+    for (int i=0; i < state_.numPlayers; ++i) {
+        state_.unseenBy[i] = state_.unseen;
     }
-#endif
-    discards_.clear();
 
     /* Secretly draw the starting hands. */
-    hands_.resize(numPlayers_);
-    for (int i=0; i < numPlayers_; ++i) {
-        hands_[i].clear();
+    for (int i=0; i < state_.numPlayers; ++i) {
+        state_.hands[i].clear();
+        state_.handIds[i].clear();
         for (int k=0; k < initialHandSize; ++k) {
-            hands_[i].push_back(this->draw_());
+            state_.handIds[i].push_back(state_.deck.size() - 1);
+            state_.hands[i].push_back(this->draw_());
+            this->cardEnteredHand_(i, state_.hands[i].back());
         }
+        this->updateHintMasks_(i);
     }
+    this->updateDerivedFacts_();
 
-    /* Run the game. */
     activeCardIsObservable_ = false;
-    activePlayer_ = 0;
+    state_.activePlayer = 0;
     movesFromActivePlayer_ = -1;
-    int score = this->runToCompletion();
-
-    return score;
 }
 
-int Server::runToCompletion() {
+template<bool Lean, int NumPlayers, int HandSize>
+int Server::runToCompletion_() {
   while (!this->gameOver()) {
-    if (log_) {
-      *log_ << "====> cards remaining: " << this->cardsRemainingInDeck() << " , empty? " << this->deck_.empty() << " , countdown " << finalCountdown_ << " , mulligans " << this->mulligansRemaining_ << " , score " << this->currentScore() << std::endl;
+    this->playTurn_<Lean, NumPlayers, HandSize>();
+  }
+
+  return this->currentScore();
+}
+
+template<bool Lean, int NumPlayers, int HandSize>
+void Server::playTurn_() {
+    const int numPlayers = this->playerCount_<NumPlayers>();
+    if (!Lean && log_) {
+      *log_ << "====> cards remaining: " << this->cardsRemainingInDeck() << " , empty? " << state_.deck.empty() << " , countdown " << (int)state_.finalCountdown << " , mulligans " << (int)state_.mulligansRemaining << " , score " << this->currentScore() << std::endl;
     }
 
-    if (activePlayer_ == 0) this->logHands_();
-    for (int i=0; i < numPlayers_; ++i) {
+    if (!Lean && state_.activePlayer == 0) this->logHands_();
+    for (int i=0; i < numPlayers; ++i) {
         observingPlayer_ = i;
         players_[i]->pleaseObserveBeforeMove(*this);
     }
-    observingPlayer_ = activePlayer_;
+    observingPlayer_ = state_.activePlayer;
     movesFromActivePlayer_ = 0;
-    players_[activePlayer_]->pleaseMakeMove(*this);  /* make a move */
+    players_[state_.activePlayer]->pleaseMakeMove(*this);  /* make a move */
     // added this short-circuit in case you forcibly end the game, toa void asserts and waiting
-    if (this->gameOver()) break;
-    HANABI_SERVER_ASSERT(movesFromActivePlayer_ != 0, "bot failed to respond to pleaseMove()");
-    assert(movesFromActivePlayer_ == 1);
+    if (this->gameOver()) return;
+    HANABI_SERVER_CHECK(movesFromActivePlayer_ != 0, "bot failed to respond to pleaseMove()");
+    assert(Lean || (movesFromActivePlayer_ == 1));
     movesFromActivePlayer_ = -1;
-    for (int i=0; i < numPlayers_; ++i) {
+    for (int i=0; i < numPlayers; ++i) {
         observingPlayer_ = i;
         players_[i]->pleaseObserveAfterMove(*this);
     }
-    activePlayer_ = (activePlayer_ + 1) % numPlayers_;
-    assert(0 <= finalCountdown_ && finalCountdown_ <= numPlayers_);
-    if (deck_.empty()) finalCountdown_ += 1;
-  }
-
-  return this->currentScore();
+    this->advanceTurn_<NumPlayers>();
 }
 
 void Server::endGameByBombingOut() {
-  mulligansRemaining_ = 0;
+  this->pushUndoEntry_();
+  state_.mulligansRemaining = 0;
 }
 
 int Server::numPlayers() const
 {
-    return numPlayers_;
+    return state_.numPlayers;
 }
 
 int Server::handSize() const
 {
-    return HAND_SIZE_OVERRIDE >= 0 ? HAND_SIZE_OVERRIDE : ((numPlayers_ <= 3) ? 5 : 4);
+    return Server::handSizeFor(state_.numPlayers);
+}
+
+int Server::handSizeFor(int numPlayers)
+{
+    if (HAND_SIZE_OVERRIDE >= 0) {
+        if (HAND_SIZE_OVERRIDE < 3 || HAND_SIZE_OVERRIDE > MAXHANDSIZE) {
+            throw ServerError("HAND_SIZE_OVERRIDE must be from 3 to " + std::to_string(MAXHANDSIZE));
+        }
+        return HAND_SIZE_OVERRIDE;
+    }
+    return (numPlayers <= 3) ? 5 : 4;
 }
 
 int Server::whoAmI() const
 {
-    assert(0 <= observingPlayer_ && observingPlayer_ < numPlayers_);
+    assert(0 <= observingPlayer_ && observingPlayer_ < state_.numPlayers);
     return observingPlayer_;
 }
 
 int Server::activePlayer() const
 {
-    return activePlayer_;
+    return state_.activePlayer;
 }
 
 int Server::sizeOfHandOfPlayer(int player) const
 {
-    HANABI_SERVER_ASSERT(0 <= player && player < numPlayers_, "player index out of bounds");
-    return hands_[player].size();
+    HANABI_SERVER_ASSERT(0 <= player && player < state_.numPlayers, "player index out of bounds");
+    return state_.hands[player].size();
+}
+
+const HandArray& Server::handOfPlayer(int player) const
+{
+    HANABI_SERVER_ASSERT(player != observingPlayer_, "cannot observe own hand");
+    HANABI_SERVER_ASSERT(0 <= player && player < state_.numPlayers, "player index out of bounds");
+    return state_.hands[player];
+}
+
+CardIndices Server::cardsMatchingHint(int player, Color color) const
+{
+    HANABI_SERVER_ASSERT(player != observingPlayer_, "cannot observe own hand");
+    HANABI_SERVER_ASSERT(0 <= player && player < state_.numPlayers, "player index out of bounds");
+    HANABI_SERVER_ASSERT(RED <= color && color <= BLUE, "invalid color");
+    return cardIndicesFromMask_(state_.colorMasks[player][color]);
 }
 
-const std::vector<Card>& Server::handOfPlayer(int player) const
+CardIndices Server::cardsMatchingHint(int player, Value value) const
 {
     HANABI_SERVER_ASSERT(player != observingPlayer_, "cannot observe own hand");
-    HANABI_SERVER_ASSERT(0 <= player && player < numPlayers_, "player index out of bounds");
-    return hands_[player];
+    HANABI_SERVER_ASSERT(0 <= player && player < state_.numPlayers, "player index out of bounds");
+    HANABI_SERVER_ASSERT(1 <= value && value <= 5, "invalid value");
+    return cardIndicesFromMask_(state_.valueMasks[player][value - ONE]);
 }
 
 const std::vector<int> Server::cardIdsOfHandOfPlayer(int player) const
 {
-    std::vector<int> res;
-    for (auto &card: hands_[player]) {
-#ifdef CARD_ID
-      res.push_back(card.id);
-#else
-      res.push_back(0);
-#endif
-    }
-    return res;
+    return std::vector<int>(state_.handIds[player].begin(), state_.handIds[player].end());
 }
 
 Card Server::activeCard() const
@@ -375,24 +514,24 @@ Pile Server::pileOf(Color color) const
 {
     int index = (int)color;
     HANABI_SERVER_ASSERT(0 <= index && index < NUMCOLORS, "invalid Color");
-    return piles_[color];
+    return Pile(color, state_.piles[color]);
 }
 
-const std::vector<Card>& Server::discards() const
+const DeckArray& Server::discards() const
 {
-    return discards_;
+    return state_.discards;
 }
 
 int Server::hintStonesUsed() const
 {
-    assert(hintStonesRemaining_ <= NUMHINTS);
-    return (NUMHINTS - hintStonesRemaining_);
+    assert(state_.hintStonesRemaining <= NUMHINTS);
+    return (NUMHINTS - state_.hintStonesRemaining);
 }
 
 int Server::hintStonesRemaining() const
 {
-    assert(hintStonesRemaining_ <= NUMHINTS);
-    return hintStonesRemaining_;
+    assert(state_.hintStonesRemaining <= NUMHINTS);
+    return state_.hintStonesRemaining;
 }
 
 bool Server::discardingIsAllowed() const
@@ -400,176 +539,169 @@ bool Server::discardingIsAllowed() const
 #ifdef HANABI_ALLOW_DISCARDING_EVEN_WITH_ALL_HINT_STONES
     return true;
 #else
-    return (hintStonesRemaining_ != NUMHINTS);
+    return (state_.hintStonesRemaining != NUMHINTS);
 #endif
 }
 
 int Server::mulligansUsed() const
 {
-    assert(mulligansRemaining_ <= NUMMULLIGANS);
-    return (NUMMULLIGANS - mulligansRemaining_);
+    assert(state_.mulligansRemaining <= NUMMULLIGANS);
+    return (NUMMULLIGANS - state_.mulligansRemaining);
 }
 
 int Server::mulligansRemaining() const
 {
-    assert(mulligansRemaining_ <= NUMMULLIGANS);
-    return mulligansRemaining_;
+    assert(state_.mulligansRemaining <= NUMMULLIGANS);
+    return state_.mulligansRemaining;
 }
 
 int Server::cardsRemainingInDeck() const
 {
-    return deck_.size();
+    return state_.deck.size();
 }
 
-int Server::finalCountdown() const
+const CardCounts& Server::unseenCards(int player) const
 {
-  return finalCountdown_;
+    if (player == -1) return state_.unseen;
+    HANABI_SERVER_ASSERT(player == observingPlayer_, "cannot count cards hidden from another player");
+    return state_.unseenBy[player];
 }
 
-void Server::pleaseDiscard(int index)
+const DerivedFacts& Server::derivedFacts() const
 {
-    assert(0 <= activePlayer_ && activePlayer_ < numPlayers_);
-    HANABI_SERVER_ASSERT(movesFromActivePlayer_ < 1, "bot attempted to move twice");
-    HANABI_SERVER_ASSERT(movesFromActivePlayer_ == 0, "called pleaseDiscard() from the wrong observer");
-    HANABI_SERVER_ASSERT(0 <= index && index <= hands_[activePlayer_].size(), "invalid card index");
-    HANABI_SERVER_ASSERT(discardingIsAllowed(), "all hint stones are already available");
+    return state_.facts;
+}
+
+int Server::finalCountdown() const
+{
+  return state_.finalCountdown;
+}
 
-    Card discardedCard = hands_[activePlayer_][index];
+template<bool Lean, int NumPlayers, int HandSize>
+void Server::pleaseDiscard_(int index)
+{
+    assert(Lean || (0 <= state_.activePlayer && state_.activePlayer < state_.numPlayers));
+    HANABI_SERVER_CHECK(movesFromActivePlayer_ < 1, "bot attempted to move twice");
+    HANABI_SERVER_CHECK(movesFromActivePlayer_ == 0, "called pleaseDiscard() from the wrong observer");
+    HANABI_SERVER_CHECK(0 <= index && index <= state_.hands[state_.activePlayer].size(), "invalid card index");
+    HANABI_SERVER_CHECK(discardingIsAllowed(), "all hint stones are already available");
+    HandArray &hand = state_.hands[state_.activePlayer];
+
+    Card discardedCard = hand[index];
     activeCard_ = discardedCard;
     activeCardIsObservable_ = true;
 
     /* Notify all the players of the discard (before it happens). */
     movesFromActivePlayer_ = -1;
     int oldObservingPlayer = observingPlayer_;
-    for (int i=0; i < numPlayers_; ++i) {
+    for (int i=0; i < this->playerCount_<NumPlayers>(); ++i) {
         observingPlayer_ = i;
-        players_[i]->pleaseObserveBeforeDiscard(*this, activePlayer_, index);
+        players_[i]->pleaseObserveBeforeDiscard(*this, state_.activePlayer, index);
     }
     observingPlayer_ = oldObservingPlayer;
     activeCardIsObservable_ = false;
 
     /* Discard the selected card. */
-    discards_.push_back(discardedCard);
+    this->pushUndoEntry_(index, discardedCard, true);
+    state_.discards.push_back(discardedCard);
 
-    if (log_) {
-        (*log_) << "Player " << activePlayer_
-                << " discarded his " << nth(index, hands_[activePlayer_].size())
+    if (!Lean && log_) {
+        (*log_) << "Player " << (int)state_.activePlayer
+                << " discarded his " << nth(index, hand.size())
                 << " card (" << discardedCard.toString() << ").\n";
     }
 
-    /* Shift the old cards down, and draw a replacement if possible. */
-    hands_[activePlayer_].erase(hands_[activePlayer_].begin() + index);
-
-    if (mulligansRemaining_ > 0 && !deck_.empty()) {
-        Card replacementCard = this->draw_();
-        hands_[activePlayer_].push_back(replacementCard);
-        if (log_) {
-            (*log_) << "Player " << activePlayer_
-                    << " drew a replacement (" << replacementCard.toString() << ").\n";
-        }
-    }
-
-    regainHintStoneIfPossible_();
+    this->replaceCard_<Lean, NumPlayers, HandSize>(index);
+    regainHintStoneIfPossible_<Lean>();
     movesFromActivePlayer_ = 1;
 }
 
-void Server::pleasePlay(int index)
+template<bool Lean, int NumPlayers, int HandSize>
+void Server::pleasePlay_(int index)
 {
-    assert(0 <= activePlayer_ && activePlayer_ < hands_.size());
-    assert(players_.size() == hands_.size());
-    HANABI_SERVER_ASSERT(movesFromActivePlayer_ < 1, "bot attempted to move twice");
-    HANABI_SERVER_ASSERT(movesFromActivePlayer_ == 0, "called pleasePlay() from the wrong observer");
-    HANABI_SERVER_ASSERT(0 <= index && index <= hands_[activePlayer_].size(), "invalid card index");
-
-    Card selectedCard = hands_[activePlayer_][index];
+    assert(Lean || (0 <= state_.activePlayer && state_.activePlayer < state_.numPlayers));
+    assert(Lean || (players_.size() == state_.numPlayers));
+    HANABI_SERVER_CHECK(movesFromActivePlayer_ < 1, "bot attempted to move twice");
+    HANABI_SERVER_CHECK(movesFromActivePlayer_ == 0, "called pleasePlay() from the wrong observer");
+    HANABI_SERVER_CHECK(0 <= index && index <= state_.hands[state_.activePlayer].size(), "invalid card index");
+    HandArray &hand = state_.hands[state_.activePlayer];
+
+    Card selectedCard = hand[index];
     activeCard_ = selectedCard;
     activeCardIsObservable_ = true;
 
     /* Notify all the players of the attempted play (before it happens). */
     movesFromActivePlayer_ = -1;
     int oldObservingPlayer = observingPlayer_;
-    for (int i=0; i < players_.size(); ++i) {
+    for (int i=0; i < this->playerCount_<NumPlayers>(); ++i) {
         observingPlayer_ = i;
-        players_[i]->pleaseObserveBeforePlay(*this, activePlayer_, index);
+        players_[i]->pleaseObserveBeforePlay(*this, state_.activePlayer, index);
     }
     observingPlayer_ = oldObservingPlayer;
     activeCardIsObservable_ = false;
 
     /* Examine the selected card. */
-    Pile &pile = piles_[(int)selectedCard.color];
-
-    if (pile.nextValueIs(selectedCard.value)) {
-        if (log_) {
-            (*log_) << "Player " << activePlayer_
-                    << " played his " << nth(index, hands_[activePlayer_].size())
+    int8_t &pile = state_.piles[(int)selectedCard.color];
+    const bool playable = (selectedCard.value == pile + 1);
+    this->pushUndoEntry_(index, selectedCard, !playable);
+
+    if (playable) {
+        if (!Lean && log_) {
+            (*log_) << "Player " << (int)state_.activePlayer
+                    << " played his " << nth(index, hand.size())
                     << " card (" << selectedCard.toString() << ").\n";
         }
-        pile.increment_();
+        ++pile;
         if (selectedCard.value == 5) {
             /* Successfully playing a 5 regains a hint stone. */
-            regainHintStoneIfPossible_();
+            regainHintStoneIfPossible_<Lean>();
         }
     } else {
         /* The card was unplayable! */
-        if (log_) {
-            (*log_) << "Player " << activePlayer_
-                    << " tried to play his " << nth(index, hands_[activePlayer_].size())
+        if (!Lean && log_) {
+            (*log_) << "Player " << (int)state_.activePlayer
+                    << " tried to play his " << nth(index, hand.size())
                     << " card (" << selectedCard.toString() << ")"
                     << " but failed.\n";
         }
-        discards_.push_back(selectedCard);
-        loseMulligan_();
+        state_.discards.push_back(selectedCard);
+        loseMulligan_<Lean>();
     }
 
-    /* Shift the old cards down, and draw a replacement if possible. */
-    hands_[activePlayer_].erase(hands_[activePlayer_].begin() + index);
-
-    if (mulligansRemaining_ > 0 && !deck_.empty()) {
-        Card replacementCard = this->draw_();
-        hands_[activePlayer_].push_back(replacementCard);
-        if (log_) {
-            (*log_) << "Player " << activePlayer_
-                    << " drew a replacement (" << replacementCard.toString() << ").\n";
-        }
-    }
-
-    this->logPiles_();
+    this->replaceCard_<Lean, NumPlayers, HandSize>(index);
+    if (!Lean) this->logPiles_();
 
     movesFromActivePlayer_ = 1;
 }
 
-void Server::pleaseGiveColorHint(int to, Color color)
+template<bool Lean, int NumPlayers, int HandSize>
+void Server::pleaseGiveColorHint_(int to, Color color)
 {
-    assert(0 <= activePlayer_ && activePlayer_ < hands_.size());
-    assert(players_.size() == hands_.size());
-    HANABI_SERVER_ASSERT(movesFromActivePlayer_ < 1, "bot attempted to move twice");
-    HANABI_SERVER_ASSERT(movesFromActivePlayer_ == 0, "called pleaseGiveColorHint() from the wrong observer");
-    HANABI_SERVER_ASSERT(0 <= to && to < hands_.size(), "invalid player index");
-    HANABI_SERVER_ASSERT(RED <= color && color <= BLUE, "invalid color");
-    HANABI_SERVER_ASSERT(hintStonesRemaining_ != 0, "no hint stones remaining");
-    HANABI_SERVER_ASSERT(to != activePlayer_, "cannot give hint to oneself");
-
-    CardIndices card_indices;
-    for (int i=0; i < hands_[to].size(); ++i) {
-        if (hands_[to][i].color == color) {
-            card_indices.add(i);
-        }
-    }
+    assert(Lean || (0 <= state_.activePlayer && state_.activePlayer < state_.numPlayers));
+    assert(Lean || (players_.size() == state_.numPlayers));
+    HANABI_SERVER_CHECK(movesFromActivePlayer_ < 1, "bot attempted to move twice");
+    HANABI_SERVER_CHECK(movesFromActivePlayer_ == 0, "called pleaseGiveColorHint() from the wrong observer");
+    HANABI_SERVER_CHECK(0 <= to && to < state_.numPlayers, "invalid player index");
+    HANABI_SERVER_CHECK(RED <= color && color <= BLUE, "invalid color");
+    HANABI_SERVER_CHECK(state_.hintStonesRemaining != 0, "no hint stones remaining");
+    HANABI_SERVER_CHECK(to != state_.activePlayer, "cannot give hint to oneself");
+
+    CardIndices card_indices = cardIndicesFromMask_(state_.colorMasks[to][color]);
 #ifndef HANABI_ALLOW_EMPTY_HINTS
-    HANABI_SERVER_ASSERT(!card_indices.empty(), "hint must include at least one card");
+    HANABI_SERVER_CHECK(!card_indices.empty(), "hint must include at least one card");
 #endif
 
-    if (log_) {
+    if (!Lean && log_) {
         const bool singular = (card_indices.size() == 1);
-        (*log_) << "Player " << activePlayer_
+        (*log_) << "Player " << (int)state_.activePlayer
                 << " told player " << to
                 << " that ";
         if (card_indices.empty()) {
             (*log_) << "none of his cards were ";
-        } else if (card_indices.size() == hands_[to].size()) {
+        } else if (card_indices.size() == state_.hands[to].size()) {
             (*log_) << "his whole hand was ";
         } else {
-            (*log_) << "his " << nth(card_indices, hands_[to].size())
+            (*log_) << "his " << nth(card_indices, state_.hands[to].size())
                 << (singular ? " card was " : " cards were ");
         }
         (*log_) << colorname(color) << ".\n";
@@ -578,48 +710,45 @@ void Server::pleaseGiveColorHint(int to, Color color)
     /* Notify all the players of the given hint. */
     movesFromActivePlayer_ = -1;
     int oldObservingPlayer = observingPlayer_;
-    for (int i=0; i < players_.size(); ++i) {
+    for (int i=0; i < this->playerCount_<NumPlayers>(); ++i) {
         observingPlayer_ = i;
-        players_[i]->pleaseObserveColorHint(*this, activePlayer_, to, color, card_indices);
+        players_[i]->pleaseObserveColorHint(*this, state_.activePlayer, to, color, card_indices);
     }
     observingPlayer_ = oldObservingPlayer;
 
-    hintStonesRemaining_ -= 1;
+    this->pushUndoEntry_();
+    state_.hintStonesRemaining -= 1;
     movesFromActivePlayer_ = 1;
 }
 
-void Server::pleaseGiveValueHint(int to, Value value)
+template<bool Lean, int NumPlayers, int HandSize>
+void Server::pleaseGiveValueHint_(int to, Value value)
 {
-    assert(0 <= activePlayer_ && activePlayer_ < hands_.size());
-    assert(players_.size() == hands_.size());
-    HANABI_SERVER_ASSERT(movesFromActivePlayer_ < 1, "bot attempted to move twice");
-    HANABI_SERVER_ASSERT(movesFromActivePlayer_ == 0, "called pleaseGiveValueHint() from the wrong observer");
-    HANABI_SERVER_ASSERT(0 <= to && to < hands_.size(), "invalid player index");
-    HANABI_SERVER_ASSERT(1 <= value && value <= 5, "invalid value");
-    HANABI_SERVER_ASSERT(hintStonesRemaining_ != 0, "no hint stones remaining");
-    HANABI_SERVER_ASSERT(to != activePlayer_, "cannot give hint to oneself");
-
-    CardIndices card_indices;
-    for (int i=0; i < hands_[to].size(); ++i) {
-        if (hands_[to][i].value == value) {
-            card_indices.add(i);
-        }
-    }
+    assert(Lean || (0 <= state_.activePlayer && state_.activePlayer < state_.numPlayers));
+    assert(Lean || (players_.size() == state_.numPlayers));
+    HANABI_SERVER_CHECK(movesFromActivePlayer_ < 1, "bot attempted to move twice");
+    HANABI_SERVER_CHECK(movesFromActivePlayer_ == 0, "called pleaseGiveValueHint() from the wrong observer");
+    HANABI_SERVER_CHECK(0 <= to && to < state_.numPlayers, "invalid player index");
+    HANABI_SERVER_CHECK(1 <= value && value <= 5, "invalid value");
+    HANABI_SERVER_CHECK(state_.hintStonesRemaining != 0, "no hint stones remaining");
+    HANABI_SERVER_CHECK(to != state_.activePlayer, "cannot give hint to oneself");
+
+    CardIndices card_indices = cardIndicesFromMask_(state_.valueMasks[to][value - ONE]);
 #ifndef HANABI_ALLOW_EMPTY_HINTS
-    HANABI_SERVER_ASSERT(!card_indices.empty(), "hint must include at least one card");
+    HANABI_SERVER_CHECK(!card_indices.empty(), "hint must include at least one card");
 #endif
 
-    if (log_) {
+    if (!Lean && log_) {
         const bool singular = (card_indices.size() == 1);
-        (*log_) << "Player " << activePlayer_
+        (*log_) << "Player " << (int)state_.activePlayer
                 << " told player " << to
                 << " that ";
         if (card_indices.empty()) {
             (*log_) << "none of his cards were ";
-        } else if (card_indices.size() == hands_[to].size()) {
+        } else if (card_indices.size() == state_.hands[to].size()) {
             (*log_) << "his whole hand was ";
         } else {
-            (*log_) << "his " << nth(card_indices, hands_[to].size())
+            (*log_) << "his " << nth(card_indices, state_.hands[to].size())
                 << (singular ? " card was " : " cards were ");
         }
         (*log_) << value
@@ -629,59 +758,335 @@ void Server::pleaseGiveValueHint(int to, Value value)
     /* Notify all the players of the given hint. */
     movesFromActivePlayer_ = -1;
     int oldObservingPlayer = observingPlayer_;
-    for (int i=0; i < players_.size(); ++i) {
+    for (int i=0; i < this->playerCount_<NumPlayers>(); ++i) {
         observingPlayer_ = i;
-        players_[i]->pleaseObserveValueHint(*this, activePlayer_, to, value, card_indices);
+        players_[i]->pleaseObserveValueHint(*this, state_.activePlayer, to, value, card_indices);
     }
     observingPlayer_ = oldObservingPlayer;
 
-    hintStonesRemaining_ -= 1;
+    this->pushUndoEntry_();
+    state_.hintStonesRemaining -= 1;
     movesFromActivePlayer_ = 1;
 }
 
+int Server::runToCompletion()
+{
+    /* Pick the game loop specialized for this shape of game. */
+    switch (state_.numPlayers * 10 + this->handSize()) {
+        case 25: return this->runToCompletion_<false, 2, 5>();
+        case 35: return this->runToCompletion_<false, 3, 5>();
+        case 44: return this->runToCompletion_<false, 4, 4>();
+        case 54: return this->runToCompletion_<false, 5, 4>();
+        default: return this->runToCompletion_<false>();
+    }
+}
+
+void Server::pleaseDiscard(int index)
+{
+    this->pleaseDiscard_<false>(index);
+    if (record_) record_->moves.push_back({RecordedMove::DISCARD, 0, (int8_t)index});
+}
+
+void Server::pleasePlay(int index)
+{
+    this->pleasePlay_<false>(index);
+    if (record_) record_->moves.push_back({RecordedMove::PLAY, 0, (int8_t)index});
+}
+
+void Server::pleaseGiveColorHint(int to, Color color)
+{
+    this->pleaseGiveColorHint_<false>(to, color);
+    if (record_) record_->moves.push_back({RecordedMove::COLOR_HINT, (int8_t)to, (int8_t)color});
+}
+
+void Server::pleaseGiveValueHint(int to, Value value)
+{
+    this->pleaseGiveValueHint_<false>(to, value);
+    if (record_) record_->moves.push_back({RecordedMove::VALUE_HINT, (int8_t)to, (int8_t)value});
+}
+
+template<bool Lean>
 void Server::regainHintStoneIfPossible_()
 {
-    if (hintStonesRemaining_ < NUMHINTS) {
-        ++hintStonesRemaining_;
-        if (log_) {
-            (*log_) << "Player " << activePlayer_
+    if (state_.hintStonesRemaining < NUMHINTS) {
+        ++state_.hintStonesRemaining;
+        if (!Lean && log_) {
+            (*log_) << "Player " << (int)state_.activePlayer
                     << " returned a hint stone; there "
-                    << ((hintStonesRemaining_ == 1) ? "is" : "are") << " now "
-                    << hintStonesRemaining_ << " remaining.\n";
+                    << ((state_.hintStonesRemaining == 1) ? "is" : "are") << " now "
+                    << (int)state_.hintStonesRemaining << " remaining.\n";
         }
     }
 }
 
+template<bool Lean>
 void Server::loseMulligan_()
 {
-    --mulligansRemaining_;
-    assert(mulligansRemaining_ >= 0);
-    if (log_) {
-        if (mulligansRemaining_ == 0) {
+    --state_.mulligansRemaining;
+    assert(Lean || (state_.mulligansRemaining >= 0));
+    if (!Lean && log_) {
+        if (state_.mulligansRemaining == 0) {
             (*log_) << "That was the last mulligan.\n";
-        } else if (mulligansRemaining_ == 1) {
+        } else if (state_.mulligansRemaining == 1) {
             (*log_) << "There is only one mulligan remaining.\n";
         } else {
-            (*log_) << "There are " << mulligansRemaining_ << " mulligans remaining.\n";
+            (*log_) << "There are " << (int)state_.mulligansRemaining << " mulligans remaining.\n";
+        }
+    }
+}
+
+Server::Checkpoint Server::checkpoint()
+{
+    journaling_ = true;
+    Checkpoint result = {
+        (int)journal_.size(), observingPlayer_, movesFromActivePlayer_,
+        activeCard_, activeCardIsObservable_
+    };
+    return result;
+}
+
+void Server::rollbackTo(const Checkpoint &checkpoint)
+{
+    assert(journaling_);
+    assert(0 <= checkpoint.journalSize && checkpoint.journalSize <= (int)journal_.size());
+    bool cardsMoved = false;
+    while ((int)journal_.size() > checkpoint.journalSize) {
+        const UndoEntry &entry = journal_.back();
+        if (entry.index >= 0) {
+            /* Put the card back where it came from, and the
+             * replacement back on top of the deck. */
+            HandArray &hand = state_.hands[entry.activePlayer];
+            HandIds &ids = state_.handIds[entry.activePlayer];
+            if (entry.drew) {
+                this->cardLeftHand_(entry.activePlayer, hand.back());
+                state_.deck.push_back(hand.back());
+                hand.pop_back();
+                ids.pop_back();
+            }
+            hand.insert(hand.begin() + entry.index, entry.card);
+            ids.insert(ids.begin() + entry.index, entry.cardId);
+            if (entry.card.color != INVALID_COLOR) {
+                state_.unseen[entry.card.index()] += 1;
+                state_.unseenBy[entry.activePlayer][entry.card.index()] += 1;
+            }
+            this->updateHintMasks_(entry.activePlayer);
+            if (entry.toDiscards) {
+                assert(state_.discards.back() == entry.card);
+                state_.discards.pop_back();
+            } else {
+                state_.piles[(int)entry.card.color] -= 1;
+            }
+            cardsMoved = true;
+        }
+        state_.activePlayer = entry.activePlayer;
+        state_.hintStonesRemaining = entry.hintStonesRemaining;
+        state_.mulligansRemaining = entry.mulligansRemaining;
+        state_.finalCountdown = entry.finalCountdown;
+        journal_.pop_back();
+    }
+    if (cardsMoved) this->updateDerivedFacts_();
+    observingPlayer_ = checkpoint.observingPlayer;
+    movesFromActivePlayer_ = checkpoint.movesFromActivePlayer;
+    activeCard_ = checkpoint.activeCard;
+    activeCardIsObservable_ = checkpoint.activeCardIsObservable;
+}
+
+void Server::pushUndoEntry_()
+{
+    if (journaling_) {
+        UndoEntry entry;
+        entry.index = -1;
+        entry.activePlayer = state_.activePlayer;
+        entry.hintStonesRemaining = state_.hintStonesRemaining;
+        entry.mulligansRemaining = state_.mulligansRemaining;
+        entry.finalCountdown = state_.finalCountdown;
+        journal_.push_back(entry);
+    }
+}
+
+void Server::pushUndoEntry_(int index, Card card, bool toDiscards)
+{
+    if (journaling_) {
+        this->pushUndoEntry_();
+        UndoEntry &entry = journal_.back();
+        entry.index = index;
+        entry.card = card;
+        entry.cardId = state_.handIds[state_.activePlayer][index];
+        entry.toDiscards = toDiscards;
+        entry.drew = false;
+    }
+}
+
+template<bool Lean, int NumPlayers, int HandSize>
+void Server::replaceCard_(int index)
+{
+    HandArray &hand = state_.hands[state_.activePlayer];
+    HandIds &ids = state_.handIds[state_.activePlayer];
+
+    /* The played or discarded card is now public; everyone but the
+     * active player had already seen it. */
+    const Card oldCard = hand[index];
+    if (oldCard.color != INVALID_COLOR) {
+        state_.unseen[oldCard.index()] -= 1;
+        state_.unseenBy[state_.activePlayer][oldCard.index()] -= 1;
+    }
+
+    /* Shift the old cards down, and draw a replacement if possible. */
+    hand.erase(hand.begin() + index);
+    ids.erase(ids.begin() + index);
+
+    if (state_.mulligansRemaining > 0 && !state_.deck.empty()) {
+        ids.push_back(state_.deck.size() - 1);
+        Card replacementCard = this->draw_();
+        hand.push_back(replacementCard);
+        this->cardEnteredHand_<NumPlayers>(state_.activePlayer, replacementCard);
+        if (journaling_) journal_.back().drew = true;
+        if (!Lean && log_) {
+            (*log_) << "Player " << (int)state_.activePlayer
+                    << " drew a replacement (" << replacementCard.toString() << ").\n";
+        }
+    }
+    this->updateHintMasks_<HandSize>(state_.activePlayer);
+    this->updateDerivedFacts_();
+}
+
+template<int NumPlayers>
+void Server::advanceTurn_()
+{
+    this->pushUndoEntry_();
+    state_.activePlayer = (state_.activePlayer + 1) % this->playerCount_<NumPlayers>();
+    assert(0 <= state_.finalCountdown && state_.finalCountdown <= state_.numPlayers);
+    if (state_.deck.empty()) state_.finalCountdown += 1;
+}
+
+/* The lean versions are used by RolloutServer, over in BotUtils.cc,
+ * which picks the kernels for its shape of game once per game. */
+#define INSTANTIATE_LEAN_KERNELS(N, H) \
+    template int Server::runToCompletion_<true, N, H>(void); \
+    template void Server::pleaseDiscard_<true, N, H>(int); \
+    template void Server::pleasePlay_<true, N, H>(int); \
+    template void Server::pleaseGiveColorHint_<true, N, H>(int, Color); \
+    template void Server::pleaseGiveValueHint_<true, N, H>(int, Value);
+INSTANTIATE_LEAN_KERNELS(0, 0)
+INSTANTIATE_LEAN_KERNELS(2, 5)
+INSTANTIATE_LEAN_KERNELS(3, 5)
+INSTANTIATE_LEAN_KERNELS(4, 4)
+INSTANTIATE_LEAN_KERNELS(5, 4)
+#undef INSTANTIATE_LEAN_KERNELS
+template void Server::advanceTurn_<0>(void);
+/* ...and this one by GameReplay, over in GameRecord.cc. */
+template void Server::playTurn_<false>(void);
+
+void Server::forkFrom_(const Server &s)
+{
+    state_ = s.state_;
+    journal_.clear();  /* our old checkpoints are meaningless now */
+    observingPlayer_ = s.whoAmI();
+    activeCardIsObservable_ = s.activeCardIsObservable_;
+    activeCard_ = activeCardIsObservable_ ? s.activeCard_ : Card(INVALID_COLOR, 1);
+
+    /* Fill the hidden cards with junk. */
+    const Card junk(INVALID_COLOR, 1);
+    for (Card &card : state_.hands[observingPlayer_]) {
+        this->cardLeftHand_(observingPlayer_, card);
+        card = junk;
+    }
+    this->updateHintMasks_(observingPlayer_);
+    for (Card &card : state_.deck) card = junk;
+}
+
+/* Everyone but the holder has now seen this card. Junk
+ * cards stand for unknown ones, so nobody has seen them. */
+template<int NumPlayers>
+void Server::cardEnteredHand_(int player, Card card)
+{
+    if (card.color == INVALID_COLOR) return;
+    for (int i=0; i < this->playerCount_<NumPlayers>(); ++i) {
+        if (i != player) state_.unseenBy[i][card.index()] -= 1;
+    }
+}
+
+void Server::cardLeftHand_(int player, Card card)
+{
+    if (card.color == INVALID_COLOR) return;
+    for (int i=0; i < state_.numPlayers; ++i) {
+        if (i != player) state_.unseenBy[i][card.index()] += 1;
+    }
+}
+template void Server::cardEnteredHand_<0>(int, Card);
+
+template<int HandSize>
+void Server::updateHintMasks_(int player)
+{
+    uint8_t *colors = state_.colorMasks[player];
+    uint8_t *values = state_.valueMasks[player];
+    std::fill(colors, colors + NUMCOLORS, 0);
+    std::fill(values, values + VALUE_MAX, 0);
+    const HandArray &hand = state_.hands[player];
+    assert(hand.size() <= handCapacity_<HandSize>());
+    for (int i=0; i < handCapacity_<HandSize>(); ++i) {
+        if (i == hand.size()) break;
+        /* Junk cards have no color, but they do have a value. */
+        if (hand[i].color != INVALID_COLOR) colors[hand[i].color] |= (1u << i);
+        values[hand[i].value - ONE] |= (1u << i);
+    }
+}
+template void Server::updateHintMasks_<0>(int);
+
+void Server::updateDerivedFacts_()
+{
+    DerivedFacts &facts = state_.facts;
+    facts.playable = facts.dead = facts.critical = 0;
+    facts.maxScore = 0;
+    for (Color color = RED; color <= BLUE; ++color) {
+        const int pile = state_.piles[(int)color];
+        bool reachable = true;
+        for (int value = 1; value <= 5; ++value) {
+            const Card card(color, value);
+            const uint32_t bit = (1u << card.index());
+            if (value <= pile) {
+                facts.dead |= bit;
+                facts.maxScore += 1;
+            } else if (!reachable) {
+                facts.dead |= bit;
+            } else {
+                if (value == pile + 1) facts.playable |= bit;
+                if (state_.unseen[card.index()] == 0) {
+                    /* Every copy of this card is in the discards,
+                     * so nothing above it can ever be played. */
+                    reachable = false;
+                } else {
+                    facts.maxScore += 1;
+                    if (state_.unseen[card.index()] == 1) facts.critical |= bit;
+                }
+            }
         }
     }
 }
 
+CardIndices Server::cardIndicesFromMask_(unsigned int mask)
+{
+    CardIndices result;
+    result.mask_ = mask;
+    result.count_ = __builtin_popcount(mask);
+    return result;
+}
+
 Card Server::draw_()
 {
-    assert(!deck_.empty());
-    Card result = deck_.back();
-    deck_.pop_back();
+    assert(!state_.deck.empty());
+    Card result = state_.deck.back();
+    state_.deck.pop_back();
     return result;
 }
 
 std::string Server::discardsAsString() const
 {
-    if (discards_.size() == 0) {
+    if (state_.discards.size() == 0) {
       return "";
     }
     std::ostringstream oss;
-    for (const Card &card : discards_) {
+    for (const Card &card : state_.discards) {
         oss << ' ' << card.toString();
     }
     return oss.str().substr(1);
@@ -690,9 +1095,9 @@ std::string Server::discardsAsString() const
 std::string Server::handsAsString() const
 {
     std::ostringstream oss;
-    for (int i=0; i < numPlayers_; ++i) {
-        for (int j=0; j < (int)hands_[i].size(); ++j) {
-            oss << (j ? ',' : ' ') << hands_[i][j].toString();
+    for (int i=0; i < state_.numPlayers; ++i) {
+        for (int j=0; j < (int)state_.hands[i].size(); ++j) {
+            oss << (j ? ',' : ' ') << state_.hands[i][j].toString();
         }
     }
     return oss.str().substr(1);
@@ -702,23 +1107,23 @@ std::string Server::pilesAsString() const
 {
     std::ostringstream oss;
     for (Color k = RED; k <= BLUE; ++k) {
-        oss << ' ' << piles_[k].size() << Card(k, 1).toString()[1];
+        oss << ' ' << (int)state_.piles[k] << Card(k, 1).toString()[1];
     }
     return oss.str().substr(1);
 }
 
-std::vector<Card> Server::cheatGetHand(int index) const
+const HandArray& Server::cheatGetHand(int index) const
 {
-  return hands_[index];
+  return state_.hands[index];
 }
 
 void Server::logHands_() const
 {
     if (log_) {
         (*log_) << "Current hands:";
-        for (int i=0; i < numPlayers_; ++i) {
-            for (int j=0; j < (int)hands_[i].size(); ++j) {
-                (*log_) << (j ? "," : " ") << hands_[i][j].toString();
+        for (int i=0; i < state_.numPlayers; ++i) {
+            for (int j=0; j < (int)state_.hands[i].size(); ++j) {
+                (*log_) << (j ? "," : " ") << state_.hands[i][j].toString();
             }
         }
         (*log_) << "\n";
@@ -730,7 +1135,7 @@ void Server::logPiles_() const
     if (log_) {
         (*log_) << "Current piles:";
         for (Color k = RED; k <= BLUE; ++k) {
-            (*log_) << " " << piles_[k].size() << Card(k, 1).toString()[1];
+            (*log_) << " " << (int)state_.piles[k] << Card(k, 1).toString()[1];
         }
         (*log_) << "\n";
     }
@@ -743,7 +1148,19 @@ std::map<std::string, std::shared_ptr<BotFactory>> &getBotFactoryMap() {
 
 void registerBotFactory(std::string name, std::shared_ptr<Hanabi::BotFactory> factory) {
   getBotFactoryMap()[name] = factory;
-  std::cerr << "Registered " << name << std::endl;
+  HANABI_LOG(DEBUG, Server) << "Registered " << name;
+}
+
+Bot *ParamsBotFactory::create(int index, int numPlayers, int handSize) const
+{
+    Params::Scope scope(params_);
+    return factory_.create(index, numPlayers, handSize);
+}
+
+void ParamsBotFactory::warmUp(int numPlayers, int handSize) const
+{
+    Params::Scope scope(params_);
+    factory_.warmUp(numPlayers, handSize);
 }
 
 std::shared_ptr<Hanabi::BotFactory> getBotFactory(const std::string &botName) {
@@ -753,5 +1170,14 @@ std::shared_ptr<Hanabi::BotFactory> getBotFactory(const std::string &botName) {
   return getBotFactoryMap().at(botName);
 }
 
+void warmUp(const std::string &botName, int numPlayers)
+{
+  const auto start = std::chrono::steady_clock::now();
+  auto botFactory = getBotFactory(botName);
+  getThreadPool();
+  botFactory->warmUp(numPlayers, Server::handSizeFor(numPlayers));
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  HANABI_LOG(INFO, Server) << "Warmed up " << botName << " for " << numPlayers << " players in " << elapsed.count() << "s";
+}
 
 }  /* namespace Hanabi */
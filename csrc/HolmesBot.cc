@@ -500,7 +500,7 @@ bool HolmesBot::maybeDiscardWorthlessCard(Server &server)
 Hint HolmesBot::bestHintForPlayer(const Server &server, int partner) const
 {
     assert(partner != me_);
-    const std::vector<Card> partners_hand = server.handOfPlayer(partner);
+    const HandArray &partners_hand = server.handOfPlayer(partner);
 
     bool is_really_playable[5];
     for (int c=0; c < partners_hand.size(); ++c) {
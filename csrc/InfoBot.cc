@@ -236,8 +236,8 @@ class OwnedGameView : public GameView {
 public:
     explicit OwnedGameView(const GameView& view, const Hanabi::Server& server) : GameView(view), server(&server) {}
 
-    const std::vector<Card>& get_hand(int p) const {
-        static_assert(std::is_same<const std::vector<Card>&, decltype(server->handOfPlayer(p))>::value, "");
+    const Hanabi::HandArray& get_hand(int p) const {
+        static_assert(std::is_same<const Hanabi::HandArray&, decltype(server->handOfPlayer(p))>::value, "");
         return server->handOfPlayer(p);
     }
 
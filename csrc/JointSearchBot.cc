@@ -18,11 +18,20 @@
 #include <array>
 #include "Hanabi.h"
 #include "JointSearchBot.h"
+#include "Log.h"
 
 using namespace Hanabi;
 using namespace HanabiParams;
-using namespace SearchBotParams;
-using namespace JointSearchBotParams;
+
+JointSearchBotParams::JointSearchBotParams(const Params::Context &params)
+  : RANGE_MAX(params.getInt("RANGE_MAX", 2000,
+      "For JointSearchBot, the max range to perform search. Higher allows more search, at a higher computational cost."))
+  , JOINT_SEARCH_SEED(params.getInt("JOINT_SEARCH_SEED", 12345,
+      "For JointSearchBot, the shared seed to use to select MC samples for search."))
+  , MEMOIZE_RANGE_SEARCH(params.getInt("MEMOIZE_RANGE_SEARCH", 0,
+      "For JointSearchBot, if 1 then speed up play by only performing common-knowledge belief updates once and copying it to the other agent."))
+{
+}
 
 static void _registerBots() {
   registerBotFactory(
@@ -43,7 +52,7 @@ JointSearchBot::JointSearchBot(int index, int numPlayers, int handSize)
       if (numPlayers > 2) {
         throw std::runtime_error("Joint search only works for 2 players.");
       }
-      std::cerr << now() << "JointSearchBotParams {" << std::endl; // legacy
+      HANABI_LOG(INFO, JointSearchBot) << "JointSearchBotParams {"; // legacy
       memoizedRange.clear();
 }
 
@@ -55,14 +64,13 @@ void JointSearchBot::applyToAll(ObservationFunc f) {
 
 void JointSearchBot::init_(const Server &server) {
 
-  std::cerr << now() << "Generating initial hand distribution..." << std::endl;
+  HANABI_LOG(INFO, JointSearchBot) << "Generating initial hand distribution...";
   DeckComposition deck = getCurrentDeckComposition(server, -1); // -1 means public
   for (int p = 0; p < server.numPlayers(); p++) {
     HandDist handDist;
     hand_dists_.push_back(handDist);
-    Hand hand;
     BotVec partners = cloneBotVec(players_, p);
-    populateInitialHandDistribution_(hand, 1, deck, server.handSize(), p, hand_dists_.back(), partners);
+    populateInitialHandDistribution_(deck, server.handSize(), hand_dists_.back(), partners);
   }
 }
 
@@ -77,11 +85,10 @@ void JointSearchBot::updateBeliefsFromDraw_(int who, int card_index, Card played
       auto& frame = history[i];
       int old_index = frame.hand_map_[card_index];
       if (old_index != -1) {
-        for (const Hand& hand : copyKeys(frame.hand_dist_)) {
-          if (hand[old_index] != played_card) {
-            frame.hand_dist_.erase(hand);
-          }
-        }
+        const PackedHand played = packHand(Hand{played_card});
+        frame.hand_dist_.filter([&](size_t h) {
+          return ((frame.hand_dist_.packed(h) >> (8 * old_index)) & 0xff) == played;
+        });
       }
       checkBeliefs_(server);
       // adjust hand map for drawn card
@@ -143,29 +150,28 @@ size_t constructPrivateBeliefs_(const Hand &partnerHand, const HandDistCDF &publ
   std::vector<boost::fibers::future<void>> futures;
   for (int t = 0; t < NUM_THREADS; t++) {
     futures.push_back(getThreadPool().enqueue([&, t]() {
-      std::array<int, 25> fast_deck;
-      for (int i = 0; i < 25; i++) fast_deck[i] = deck.at(indexToCard(i));
+      DeckComposition fast_deck = deck;
       for (int i = t; i < publicPDF.probs.size(); i += NUM_THREADS) {
-        const Hand &my_hand = publicPDF.hands.at(i);
+        const Hand my_hand = unpackHand(publicPDF.hands.at(i));
         double old_prior = 1, new_prior = 1;
         for (const Card &card : my_hand) {
           int card_idx = cardToIndex(card);
-          old_prior *= fast_deck[card_idx];
-          fast_deck[card_idx]--;
+          old_prior *= fast_deck.counts[card_idx];
+          fast_deck.counts[card_idx]--;
         }
         assert(old_prior > 0);
-        for (const Card &card : my_hand) fast_deck[cardToIndex(card)]++;  // fix the deck back up
+        for (const Card &card : my_hand) fast_deck[card]++;  // fix the deck back up
 
-        for (const Card &card : partnerHand) fast_deck[cardToIndex(card)]--;
+        for (const Card &card : partnerHand) fast_deck[card]--;
         // addToDeck(my_hand, deck); // fix the deck back up
         // removeFromDeck(partnerHand, deck);
         for (const Card &card : my_hand) {
           int card_idx = cardToIndex(card);
-          new_prior *= fast_deck[card_idx];
-          fast_deck[card_idx]--;
+          new_prior *= fast_deck.counts[card_idx];
+          fast_deck.counts[card_idx]--;
         }
-        for (const Card &card : my_hand) fast_deck[cardToIndex(card)]++;  // fix the deck back up
-        for (const Card &card : partnerHand) fast_deck[cardToIndex(card)]++;  // fix the deck back up
+        for (const Card &card : my_hand) fast_deck[card]++;  // fix the deck back up
+        for (const Card &card : partnerHand) fast_deck[card]++;  // fix the deck back up
         double new_prob = publicPDF.probs.at(i) * new_prior / old_prior;
 
         privatePDF.probs[i] = new_prob;
@@ -185,16 +191,17 @@ void JointSearchBot::pleaseMakeMove(Server &server)
     updateFrames_(me_, server);
     simulserver_.sync(server);
     Move bp_move = simulserver_.simulatePlayerMove(me_, players_[me_].get());
-    std::cerr << now() << "Frame " << numFrames_ << " : Blueprint strat says to play " << bp_move.toString() << std::endl;
+    HANABI_LOG(INFO, JointSearchBot) << "Frame " << numFrames_ << " : Blueprint strat says to play " << bp_move.toString();
     SearchStats stats;
     size_t num_partner_beliefs = hand_dists_[1 - me_].size();
-    std::cerr << now() << "  My partner has " << num_partner_beliefs << " public beliefs. " << std::endl;
+    HANABI_LOG(INFO, JointSearchBot) << "  My partner has " << num_partner_beliefs << " public beliefs. ";
     Move move;
+    const int iters_before = total_iters_;
     if (history_[me_].size() > 0) {
-      std::cerr << now() << "  Bailing from search because I dont know my beliefs." << std::endl;
+      HANABI_LOG(INFO, JointSearchBot) << "  Bailing from search because I dont know my beliefs.";
       move = bp_move;
     } else {
-      applyDelayedObservations(hand_dists_[me_], copyKeys(hand_dists_[me_]));
+      applyDelayedObservations(hand_dists_[me_], params_);
       HandDistCDF pdf = populateHandDistPDF(hand_dists_[me_]);
       size_t num_private_beliefs = constructPrivateBeliefs_(
         server.handOfPlayer(1 - me_), pdf, pdf, server);
@@ -202,17 +209,17 @@ void JointSearchBot::pleaseMakeMove(Server &server)
       pdfToCdf(pdf, cdf);
 
       assert(num_private_beliefs > 0);
-      std::mt19937 search_gen(JOINT_SEARCH_SEED); // coordinate on seed yuck
+      std::mt19937 search_gen(joint_params_.JOINT_SEARCH_SEED); // coordinate on seed yuck
       move = doSearch_(me_, bp_move, Move(), players_[me_].get(), hand_dists_[me_], cdf, stats, search_gen, server);
-      logSearchResults(stats, server.numPlayers(), me_);
-      if (move != bp_move) std::cerr << now() << "Search changed the move. ";
-      std::cerr << now() << "Blueprint picked " << bp_move.toString() << " with average score " << stats[bp_move].mean
-                << "; search picked " << move.toString() << " with average score " << stats[move].mean << std::endl;
+      logSearchResults(stats, server.numPlayers(), me_, params_);
+      HANABI_LOG(INFO, JointSearchBot) << (move != bp_move ? "Search changed the move. " : "")
+                << "Blueprint picked " << bp_move.toString() << " with average score " << stats[bp_move].mean
+                << "; search picked " << move.toString() << " with average score " << stats[move].mean;
 
       if (move != bp_move) {
         changed_moves_++;
         score_difference_ += stats[move].mean - stats[bp_move].mean;
-        if (DOUBLE_SEARCH) {
+        if (params_.DOUBLE_SEARCH) {
           SearchStats unbiased_stats;
           SearchStats unbiased_win_stats;
           doSearch_(me_, bp_move, Move(), players_[me_].get(), hand_dists_[me_], cdf, unbiased_stats, gen_, server, false, &unbiased_win_stats);
@@ -223,6 +230,16 @@ void JointSearchBot::pleaseMakeMove(Server &server)
         }
       }
     }
+    last_move_metrics_.beliefRangeSize = hand_dists_[me_].size();
+    last_move_metrics_.beliefBytes = 0;
+    for (int p = 0; p < hand_dists_.size(); p++) {
+      last_move_metrics_.beliefBytes += hand_dists_[p].memoryUsage();
+      for (auto &frame : history_[p]) {
+        last_move_metrics_.beliefBytes += frame.hand_dist_.memoryUsage() + frame.partner_hand_dist_.memoryUsage();
+      }
+    }
+    last_move_metrics_.rollouts = total_iters_ - iters_before;
+    last_move_metrics_.deviated = (move != bp_move);
     execute_(me_, move, server);
 }
 
@@ -240,83 +257,97 @@ void JointSearchBot::pleaseObserveBeforeMove(const Server &server) {
   updateFrames_(server.activePlayer(), server);
 }
 
-void JointSearchBot::propagatePrunedHand_(int who, int frame_idx, const Hand &hand) {
+void JointSearchBot::propagatePrunedHands_(int who, int frame_idx, const std::vector<Hand> &hands) {
   assert(frame_idx < history_[who].size());
+  if (hands.empty()) {
+    return;
+  }
   // auto &cur_frame = history_[who][frame_idx];
   bool is_last_frame = frame_idx == history_[who].size() - 1;
   auto &next_hand_dist = is_last_frame ? hand_dists_[who] : history_[who][frame_idx + 1].hand_dist_;
   Move my_next_move = is_last_frame ? Move() : history_[who][frame_idx + 1].last_move_;
   int draw_index = is_last_frame ? -1 : (my_next_move.type == PLAY_CARD || my_next_move.type == DISCARD_CARD) ? my_next_move.value : -1;
-  if (draw_index == -1) {
-    if (next_hand_dist.count(hand)) {
-      next_hand_dist.erase(hand);
-      if (!is_last_frame) propagatePrunedHand_(who, frame_idx + 1, hand);
+  // the hands in the next frame that these hands became
+  std::vector<uint8_t> pruned(next_hand_dist.size(), 0);
+  std::vector<Hand> next_hands;
+  auto prune = [&](const Hand &next_hand) {
+    size_t i = next_hand_dist.find(next_hand);
+    if (i != HandDist::npos && !pruned[i]) {
+      pruned[i] = 1;
+      next_hands.push_back(next_hand);
     }
-  } else {
-    Hand new_hand = hand;
-    new_hand.erase(new_hand.begin() + draw_index);
-    for (int card_idx = 0; card_idx < 25; card_idx++) {
-      Card drawn = indexToCard(card_idx);
-      new_hand.push_back(drawn);
-      if (next_hand_dist.count(new_hand)) {
-        next_hand_dist.erase(new_hand);
-        if (!is_last_frame) propagatePrunedHand_(who, frame_idx + 1, new_hand);
+  };
+  for (const Hand &hand : hands) {
+    if (draw_index == -1) {
+      prune(hand);
+    } else {
+      Hand new_hand = hand;
+      new_hand.erase(new_hand.begin() + draw_index);
+      for (int card_idx = 0; card_idx < 25; card_idx++) {
+        Card drawn = indexToCard(card_idx);
+        new_hand.push_back(drawn);
+        prune(new_hand);
+        new_hand.pop_back();
       }
-      new_hand.pop_back();
     }
   }
+  next_hand_dist.filter([&](size_t i) { return !pruned[i]; });
+  if (!is_last_frame) propagatePrunedHands_(who, frame_idx + 1, next_hands);
 }
 
 void JointSearchBot::updateFrames_(int who, const Server &server) {
   auto &history = history_[who];
   int init_num_frames = history.size();
   int from = 1 - who;
-  std::cerr << now() << "(P" << me_ << ") updateFrames_ P " << who << ": " << history.size() << " frames." << std::endl;
+  HANABI_LOG(DEBUG, JointSearchBot) << "(P" << me_ << ") updateFrames_ P " << who << ": " << history.size() << " frames.";
   while (history.size() > 0) {
     auto &frame = history[0];
     auto &hand_dist = frame.hand_dist_;
 
-    if (RANGE_MAX >= 0 && hand_dist.size() > RANGE_MAX) {
+    if (joint_params_.RANGE_MAX >= 0 && hand_dist.size() > joint_params_.RANGE_MAX) {
       break;
     }
     // alright! we can do an update!
     auto &frame_simulserver = frame.simulserver_;
     assert(frame_simulserver.numPlayers() == 2);
-    std::cerr << now() << " Frame " << frame.frame_idx_
+    HANABI_LOG(DEBUG, JointSearchBot) << " Frame " << frame.frame_idx_
               << " : Looking for hands for P " << who
               << " consistent with P " << from << " action " << frame.move_.toString()
-              << " (range= " << frame.hand_dist_.size() << " , partner range= " << frame.partner_hand_dist_.size() << " )" << std::endl;
+              << " (range= " << frame.hand_dist_.size() << " , partner range= " << frame.partner_hand_dist_.size() << " )";
 
     auto memoize_key = std::tie(from, frame.frame_idx_);
     if (memoizedRange.count(memoize_key)) {
-      std::cerr << now() << "Using memoized values to update frame " << frame.frame_idx_ << std::endl;
+      HANABI_LOG(DEBUG, JointSearchBot) << "Using memoized values to update frame " << frame.frame_idx_;
       auto &my_memoized_range = memoizedRange[memoize_key];
+      std::vector<uint8_t> pruned(hand_dist.size(), 0);
       for (auto &hand : my_memoized_range) {
         assert(hand_dist.count(hand));
-        hand_dist.erase(hand);
-        propagatePrunedHand_(who, 0, hand);
+        pruned[hand_dist.find(hand)] = 1;
       }
-      std::cerr << now() << "  Filtered historical range down to " << hand_dist.size() << " (MEMOIZED) " << std::endl;
+      hand_dist.filter([&](size_t i) { return !pruned[i]; });
+      propagatePrunedHands_(who, 0, my_memoized_range);
+      HANABI_LOG(DEBUG, JointSearchBot) << "  Filtered historical range down to " << hand_dist.size() << " (MEMOIZED) ";
       checkBeliefs_(server);
       history.erase(history.begin());
       continue;
     }
-    auto hand_dist_keys = copyKeys(hand_dist);
-    std::vector<Hand> my_memoized_range;
+    std::vector<Hand> my_pruned_range;
 
-    std::cerr << now() << "Applying delayed obs on my hand dist..." << std::endl;
-    applyDelayedObservations(hand_dist, hand_dist_keys);
-    std::cerr << now() << "Applying delayed obs on partner dist..." << std::endl;
-    applyDelayedObservations(frame.partner_hand_dist_, copyKeys(frame.partner_hand_dist_));
-    std::cerr << now() << "Done delayed updates." << std::endl;
+    HANABI_LOG(DEBUG, JointSearchBot) << "Applying delayed obs on my hand dist...";
+    applyDelayedObservations(hand_dist, params_);
+    HANABI_LOG(DEBUG, JointSearchBot) << "Applying delayed obs on partner dist...";
+    applyDelayedObservations(frame.partner_hand_dist_, params_);
+    HANABI_LOG(DEBUG, JointSearchBot) << "Done delayed updates.";
 
     HandDistCDF public_pdf = populateHandDistPDF(frame.partner_hand_dist_);
     HandDistCDF private_cdf = populateHandDistPDF(frame.partner_hand_dist_); // not done
-    for (int i = 0; i < hand_dist_keys.size(); i++) {
-      const Hand &hand = hand_dist_keys[i];
-      auto &distval = hand_dist[hand];
+    SimulServer my_server(frame_simulserver);
+    std::vector<uint8_t> pruned(hand_dist.size(), 0);
+    for (size_t i = 0; i < hand_dist.size(); i++) {
+      const Hand hand = hand_dist.hand(i);
+      auto &distval = hand_dist.val(i);
 
-      SimulServer my_server(frame_simulserver);
+      my_server.sync(frame_simulserver); // a flat copy; cheaper than a new server per hand
       my_server.setHand(who, hand);
       assert(my_server.whoAmI() == frame_simulserver.whoAmI());
       auto from_bot = distval.getPartner(from);
@@ -332,7 +363,7 @@ void JointSearchBot::updateFrames_(int who, const Server &server) {
       }
       pdfToCdf(private_cdf, private_cdf);
 
-      std::mt19937 search_gen(JOINT_SEARCH_SEED); // coordinate on seed yuck
+      std::mt19937 search_gen(joint_params_.JOINT_SEARCH_SEED); // coordinate on seed yuck
       SearchStats stats;
       // move = doSearch_(me_, bp_move, players_[me_].get(), my_private_beliefs, stats, search_gen, server);
       Move cf_move = doSearch_(from, bp_move, frame.move_, from_bot.get(), frame.partner_hand_dist_, private_cdf, stats, search_gen, my_server, false);
@@ -340,29 +371,29 @@ void JointSearchBot::updateFrames_(int who, const Server &server) {
       //   << " true_move= " << frame.move_.toString() << " (score= " << stats[frame.move_].mean
       //   << " ) pred_move= " << cf_move.toString() << " (score= " << stats[cf_move].mean << " )" << std::endl;
       if (frame.move_ != cf_move) {
-        hand_dist.erase(hand);
-        if(MEMOIZE_RANGE_SEARCH) {
-          my_memoized_range.push_back(hand);
-        }
-        // std::cerr << now() << " Gonna propagate pruning of hand " << handAsString(hand) << " ; current beliefs contain " << hand_dists_[who].size() << std::endl;
-        propagatePrunedHand_(who, 0, hand);
-        // std::cerr << now() << " post-pruned beliefs contain " << hand_dists_[who].size() << std::endl;
-        checkBeliefs_(server);
+        pruned[i] = 1;
+        my_pruned_range.push_back(hand);
       }
     }
-    if (MEMOIZE_RANGE_SEARCH) {
-      memoizedRange[memoize_key] = my_memoized_range;
+    // the pruned hands are only removed now, all at once, as is their
+    // pruning from the later frames
+    hand_dist.filter([&](size_t i) { return !pruned[i]; });
+    propagatePrunedHands_(who, 0, my_pruned_range);
+    if (joint_params_.MEMOIZE_RANGE_SEARCH) {
+      memoizedRange[memoize_key] = my_pruned_range;
     }
-    std::cerr << now() << "  Filtered historical range down to " << hand_dist.size() << std::endl;
+    HANABI_LOG(DEBUG, JointSearchBot) << "  Filtered historical range down to " << hand_dist.size();
 
     checkBeliefs_(server);
     history.erase(history.begin()); // FIXME: use more efficient data structure or use SmartPtr to avoid copies
     if (history.size() == 0) {
-      std::cerr << now() << "Woo! pushed up to the present!" << std::endl;
+      HANABI_LOG(INFO, JointSearchBot) << "Woo! pushed up to the present!";
     }
   }
-  if (init_num_frames != history.size()) std::cerr << now() << "updateFrames_ reduced history from " << init_num_frames << " to " << history.size() << " frames." << std::endl;
-  std::cerr << now() << "updateFrames_ done." << std::endl;
+  if (init_num_frames != history.size()) {
+    HANABI_LOG(INFO, JointSearchBot) << "updateFrames_ reduced history from " << init_num_frames << " to " << history.size() << " frames.";
+  }
+  HANABI_LOG(DEBUG, JointSearchBot) << "updateFrames_ done.";
 }
 
 
@@ -380,21 +411,21 @@ void JointSearchBot::filterBeliefsConsistentWithAction_(const Move &move, int fr
     // update them.
     assert(history_[who].size() == 0);
     auto &hand_dist = hand_dists_[who];
-    auto hand_dist_keys = copyKeys(hand_dist);
-    applyDelayedObservations(hand_dist, hand_dist_keys);
+    const size_t old_size = hand_dist.size();
+    applyDelayedObservations(hand_dist, params_);
     std::vector<boost::fibers::future<void>> futures;
     for (int t = 0; t < NUM_THREADS; t++) {
       futures.push_back(getThreadPool().enqueue([&, t]() {
-        for (int i = t; i < hand_dist_keys.size(); i += NUM_THREADS) {
-          const Hand &hand = hand_dist_keys[i];
-          auto bot = hand_dist.at(hand).getPartner(from);
+        for (size_t i = t; i < hand_dist.size(); i += NUM_THREADS) {
+          const Hand hand = hand_dist.hand(i);
+          auto bot = hand_dist.val(i).getPartner(from);
           SimulServer my_server(server);
           my_server.setHand(who, hand);
           assert(my_server.whoAmI() == server.whoAmI());
           Move bp_move = my_server.simulatePlayerMove(from, bot.get());
           my_server.setObservingPlayer(from); // so that we copy over who's hand in sync()
           if (move != bp_move) {
-            hand_dist[hand].prob = 0;
+            hand_dist.prob(i) = 0;
           }
         }
       }));
@@ -402,20 +433,16 @@ void JointSearchBot::filterBeliefsConsistentWithAction_(const Move &move, int fr
     for (auto &f: futures) {
       f.get();
     }
-    for (auto &hand: hand_dist_keys) {
-      if (hand_dist[hand].prob == 0) {
-        hand_dist.erase(hand);
-      }
-    }
-    std::cerr << now() << "Filtered current beliefs consistent with player " << from << " BLUEPRINT action '" << move.toString()
-              << "' reduced from " << hand_dist_keys.size() << " to " <<
-              hand_dist.size() << std::endl;
+    hand_dist.eraseZeroProb();
+    HANABI_LOG(DEBUG, JointSearchBot) << "Filtered current beliefs consistent with player " << from << " BLUEPRINT action '" << move.toString()
+              << "' reduced from " << old_size << " to " <<
+              hand_dist.size();
     checkBeliefs_(server);
   } else {
     // in this case my partner played search. If my history is empty I can update
     // my beliefs directly, but it's simpler to just push it onto the end of the
     // history and do the full history update
-    std::cerr << now() << "Player " << from << " did search; pushing a frame for player " << who << " ; frames= " << history_[who].size() + 1 << std::endl;
+    HANABI_LOG(DEBUG, JointSearchBot) << "Player " << from << " did search; pushing a frame for player " << who << " ; frames= " << history_[who].size() + 1;
     history_[who].emplace_back(*this, who, move, server);
 
   }
@@ -426,14 +453,10 @@ BeliefFrame::BeliefFrame(const JointSearchBot &bot, int who, const Move &move, c
   , move_(move)
   , last_move_(bot.last_move_[who])
   , cheat_hand_(server.cheatGetHand(who))
-  , simulserver_(server) {
+  , simulserver_(server)
+  , hand_dist_(bot.hand_dists_[who])
+  , partner_hand_dist_(bot.hand_dists_[1 - who]) {
     for (int i = 0; i < server.sizeOfHandOfPlayer(who); i++) {
       hand_map_.push_back(i);
     }
-    for (auto &kv : bot.hand_dists_[who]) {
-      hand_dist_[kv.first] = kv.second;
-    }
-    for (auto &kv : bot.hand_dists_[1 - who]) {
-      partner_hand_dist_[kv.first] = kv.second;
-    }
   }
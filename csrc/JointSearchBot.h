@@ -13,17 +13,14 @@
 struct BeliefFrame;
 
 
-namespace JointSearchBotParams {
+/* JointSearchBot's own parameters, read like SearchBotParams. */
+struct JointSearchBotParams {
+  int RANGE_MAX;
+  int JOINT_SEARCH_SEED;
+  int MEMOIZE_RANGE_SEARCH;
 
-  // read in parameters from environment variables
-  const int RANGE_MAX = Params::getParameterInt("RANGE_MAX", 2000,
-    "For JointSearchBot, the max range to perform search. Higher allows more search, at a higher computational cost.");
-  const int JOINT_SEARCH_SEED = Params::getParameterInt("JOINT_SEARCH_SEED", 12345,
-    "For JointSearchBot, the shared seed to use to select MC samples for search.");
-  const int MEMOIZE_RANGE_SEARCH = Params::getParameterInt("MEMOIZE_RANGE_SEARCH", 0,
-    "For JointSearchBot, if 1 then speed up play by only performing common-knowledge belief updates once and copying it to the other agent.");
-
-} // namespace SearchBotParams
+  explicit JointSearchBotParams(const Params::Context &params = Params::Context::current());
+};
 
 
 struct JointSearchBot : public SearchBot {
@@ -45,7 +42,10 @@ protected:
 
   void insertBeliefFrame_(int who, const Hanabi::Server &server);
   void updateFrames_(int who, const Hanabi::Server &server);
-  void propagatePrunedHand_(int who, int frame_idx, const Hand &hand);
+  /* Removes the hands that these hands of frame_idx became from every
+   * later frame and from the present beliefs. */
+  void propagatePrunedHands_(int who, int frame_idx, const std::vector<Hand> &hands);
+  const JointSearchBotParams joint_params_;
   std::vector<HandDist> hand_dists_;
   // std::vector<int> cached_num_beliefs_;
 
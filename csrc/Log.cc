@@ -0,0 +1,230 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include "Log.h"
+
+namespace Log {
+
+static const char *const levelNames[] = { "debug", "info", "warn", "error", "off" };
+static const char *const moduleNames[NUM_MODULES] = {
+    "Server", "Params", "Bots", "SearchBot", "JointSearchBot", "TorchBot", "PyBot",
+};
+
+static std::string lowercase(std::string s)
+{
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return std::tolower(c); });
+    return s;
+}
+
+static int parseLevel(const std::string &name)
+{
+    for (int level = HANABI_LOG_LEVEL_DEBUG; level <= HANABI_LOG_LEVEL_OFF; ++level) {
+        if (lowercase(name) == levelNames[level]) return level;
+    }
+    throw std::runtime_error("unknown log level " + name);
+}
+
+static int parseModule(const std::string &name)
+{
+    for (int module = 0; module < NUM_MODULES; ++module) {
+        if (lowercase(name) == lowercase(moduleNames[module])) return module;
+    }
+    throw std::runtime_error("unknown log module " + name);
+}
+
+/* Parses a spec like LOG_LEVEL's into a level for every module. */
+static void parseSpec(const std::string &spec, std::atomic<int> *levels)
+{
+    int defaultLevel = HANABI_LOG_LEVEL_INFO;
+    int moduleLevels[NUM_MODULES];
+    std::fill(moduleLevels, moduleLevels + NUM_MODULES, -1);
+    size_t start = 0;
+    while (start <= spec.size()) {
+        size_t end = spec.find(',', start);
+        if (end == std::string::npos) end = spec.size();
+        const std::string item = spec.substr(start, end - start);
+        const size_t eq = item.find('=');
+        if (eq == std::string::npos) {
+            if (!item.empty()) defaultLevel = parseLevel(item);
+        } else {
+            moduleLevels[parseModule(item.substr(0, eq))] = parseLevel(item.substr(eq + 1));
+        }
+        start = end + 1;
+    }
+    for (int module = 0; module < NUM_MODULES; ++module) {
+        levels[module] = (moduleLevels[module] >= 0) ? moduleLevels[module] : defaultLevel;
+    }
+}
+
+/* The enabled level of each module. These are read on every HANABI_LOG,
+ * so they're kept apart from the Writer, which is only started once
+ * something is actually logged. */
+static std::atomic<int> *levels()
+{
+    static std::atomic<int> levels[NUM_MODULES];
+    static bool configured = [] {
+        const char *spec = std::getenv("LOG_LEVEL");
+        try {
+            parseSpec(spec ? spec : "", levels);
+        } catch (const std::runtime_error &e) {
+            std::cerr << "LOG_LEVEL: " << e.what() << std::endl;
+            parseSpec("", levels);
+        }
+        return true;
+    }();
+    (void)configured;
+    return levels;
+}
+
+bool enabled(int level, Module module)
+{
+    return level >= levels()[(int)module].load(std::memory_order_relaxed);
+}
+
+void configure(const std::string &spec)
+{
+    std::atomic<int> parsed[NUM_MODULES];
+    parseSpec(spec, parsed);
+    std::atomic<int> *current = levels();
+    for (int module = 0; module < NUM_MODULES; ++module) current[module] = parsed[module].load();
+}
+
+/* Messages are pushed onto a lock-free stack by the threads logging them;
+ * the writer thread takes the whole stack at once and writes it out in
+ * the order the messages were pushed. */
+struct Entry {
+    Entry *next;
+    std::chrono::system_clock::time_point time;
+    int level;
+    Module module;
+    std::string text;
+};
+
+class Writer {
+public:
+    Writer() : thread_([this] { this->run_(); }) { }
+
+    ~Writer() {
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex_);
+            stopping_ = true;
+        }
+        wake_.notify_one();
+        thread_.join();
+        this->drain();
+    }
+
+    void push(Entry *entry) {
+        Entry *old = head_.load(std::memory_order_relaxed);
+        do {
+            entry->next = old;
+        } while (!head_.compare_exchange_weak(old, entry, std::memory_order_release, std::memory_order_relaxed));
+        /* Only the first message of a batch wakes the writer; a wakeup lost
+         * to the race with its going to sleep is made up by its timeout. */
+        if (old == nullptr) wake_.notify_one();
+    }
+
+    void drain() {
+        std::lock_guard<std::mutex> lock(writeMutex_);
+        Entry *entry = head_.exchange(nullptr, std::memory_order_acquire);
+        if (entry == nullptr) return;
+        Entry *ordered = nullptr;
+        while (entry != nullptr) {
+            Entry *next = entry->next;
+            entry->next = ordered;
+            ordered = entry;
+            entry = next;
+        }
+        std::string out;
+        while (ordered != nullptr) {
+            Entry *next = ordered->next;
+            this->appendTimestamp_(ordered->time, out);
+            out += levelNames[ordered->level];
+            out += ' ';
+            out += moduleNames[(int)ordered->module];
+            out += ": ";
+            out += ordered->text;
+            out += '\n';
+            delete ordered;
+            ordered = next;
+        }
+        std::cerr.write(out.data(), out.size());
+        std::cerr.flush();
+    }
+
+private:
+    void run_() {
+        std::unique_lock<std::mutex> lock(wakeMutex_);
+        while (!stopping_) {
+            wake_.wait_for(lock, std::chrono::milliseconds(100), [this] {
+                return stopping_ || head_.load(std::memory_order_relaxed) != nullptr;
+            });
+            lock.unlock();
+            this->drain();
+            lock.lock();
+        }
+    }
+
+    /* localtime() is slow, so it's only called once a second. */
+    void appendTimestamp_(std::chrono::system_clock::time_point time, std::string &out) {
+        const std::time_t seconds = std::chrono::system_clock::to_time_t(time);
+        if (seconds != stampSeconds_) {
+            std::tm tm;
+            localtime_r(&seconds, &tm);
+            std::strftime(stamp_, sizeof stamp_, "%Y-%m-%d %H:%M:%S", &tm);
+            stampSeconds_ = seconds;
+        }
+        const int millis = (int)(std::chrono::duration_cast<std::chrono::milliseconds>(
+            time.time_since_epoch()).count() % 1000);
+        out += stamp_;
+        out += '.';
+        out += (char)('0' + millis / 100);
+        out += (char)('0' + millis / 10 % 10);
+        out += (char)('0' + millis % 10);
+        out += "  ";
+    }
+
+    std::atomic<Entry *> head_{nullptr};
+    std::mutex writeMutex_;  /* held while writing; guards the stamp too */
+    std::time_t stampSeconds_ = -1;
+    char stamp_[32];
+    std::mutex wakeMutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    std::thread thread_;  /* last, so it starts once the rest is ready */
+};
+
+static Writer &writer()
+{
+    static Writer writer;
+    return writer;
+}
+
+void flush()
+{
+    writer().drain();
+}
+
+Message::~Message()
+{
+    Writer &w = writer();
+    w.push(new Entry{nullptr, std::chrono::system_clock::now(), level_, module_, stream_.str()});
+    if (level_ >= HANABI_LOG_LEVEL_WARN) w.drain();
+}
+
+}  /* namespace Log */
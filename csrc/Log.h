@@ -0,0 +1,88 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+
+#pragma once
+
+#include <sstream>
+#include <string>
+
+/* Diagnostics, e.g.
+ *   HANABI_LOG(DEBUG, SearchBot) << "Filtered beliefs down to " << n;
+ *
+ * A message is only formatted if its level is enabled for its module, and
+ * then it's queued and written to stderr, timestamped, by a background
+ * thread; so logging from the search threads doesn't serialize them on
+ * stderr. WARN and ERROR messages are written out before HANABI_LOG
+ * returns, along with everything queued ahead of them, so nothing is lost
+ * if the process dies right after.
+ *
+ * Which levels are enabled is set at run time by the LOG_LEVEL environment
+ * variable (or Log::configure()), a default level optionally followed by
+ * per-module levels: e.g. LOG_LEVEL=info,SearchBot=debug,Server=warn.
+ * The default is info.
+ *
+ * Levels below HANABI_LOG_COMPILED_LEVEL aren't compiled in at all; e.g.
+ * building with -DHANABI_LOG_COMPILED_LEVEL=1 makes every
+ * HANABI_LOG(DEBUG, ...) statement dead code, arguments and all. */
+
+#define HANABI_LOG_LEVEL_DEBUG 0
+#define HANABI_LOG_LEVEL_INFO 1
+#define HANABI_LOG_LEVEL_WARN 2
+#define HANABI_LOG_LEVEL_ERROR 3
+#define HANABI_LOG_LEVEL_OFF 4
+
+#ifndef HANABI_LOG_COMPILED_LEVEL
+#define HANABI_LOG_COMPILED_LEVEL HANABI_LOG_LEVEL_DEBUG
+#endif
+
+/* Whether HANABI_LOG(level, module) would log anything; for guarding
+ * code that builds up a message piece by piece. */
+#define HANABI_LOG_IS_ON(level, module) \
+    (HANABI_LOG_LEVEL_##level >= HANABI_LOG_COMPILED_LEVEL && \
+     ::Log::enabled(HANABI_LOG_LEVEL_##level, ::Log::Module::module))
+
+/* A stream to write one message to; a trailing newline is added. */
+#define HANABI_LOG(level, module) \
+    if (!(HANABI_LOG_LEVEL_##level >= HANABI_LOG_COMPILED_LEVEL && \
+          ::Log::enabled(HANABI_LOG_LEVEL_##level, ::Log::Module::module))) { } \
+    else ::Log::Message(HANABI_LOG_LEVEL_##level, ::Log::Module::module).stream()
+
+namespace Log {
+
+enum class Module {
+    Server,          /* the server and the evaluation harness */
+    Params,          /* parameter values, as they are read */
+    Bots,            /* the heuristic bots and BotUtils */
+    SearchBot,
+    JointSearchBot,
+    TorchBot,
+    PyBot,
+};
+constexpr int NUM_MODULES = 7;
+
+bool enabled(int level, Module module);
+
+/* Sets the enabled levels from a spec like LOG_LEVEL's, replacing the
+ * previous ones. Throws std::runtime_error on a malformed spec. */
+void configure(const std::string &spec);
+
+/* Waits until every message logged so far has been written. */
+void flush();
+
+class Message {
+public:
+    Message(int level, Module module) : level_(level), module_(module) { }
+    ~Message();
+    Message(const Message &) = delete;
+    Message &operator=(const Message &) = delete;
+    std::ostream &stream() { return stream_; }
+private:
+    int level_;
+    Module module_;
+    std::ostringstream stream_;
+};
+
+}  /* namespace Log */
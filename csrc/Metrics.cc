@@ -0,0 +1,108 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+
+#include <cassert>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Hanabi.h"
+#include "Metrics.h"
+
+namespace Hanabi {
+
+/* Passes everything through to the wrapped bot, timing its moves. */
+class MeteredBot final : public Bot {
+public:
+    MeteredBot(Bot *bot, int index, std::vector<MoveSample> *samples)
+        : bot_(bot), index_(index), samples_(samples) {}
+    Bot *bot_;
+
+    void pleaseObserveBeforeMove(const Server &server) override {
+        bot_->pleaseObserveBeforeMove(server);
+    }
+    void pleaseMakeMove(Server &server) override {
+        const auto start = std::chrono::steady_clock::now();
+        bot_->pleaseMakeMove(server);
+        const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        MoveSample sample = { index_, elapsed.count(), bot_->getMoveMetrics() };
+        samples_->push_back(sample);
+    }
+    void pleaseObserveBeforeDiscard(const Server &server, int from, int card_index) override {
+        bot_->pleaseObserveBeforeDiscard(server, from, card_index);
+    }
+    void pleaseObserveBeforePlay(const Server &server, int from, int card_index) override {
+        bot_->pleaseObserveBeforePlay(server, from, card_index);
+    }
+    void pleaseObserveColorHint(const Server &server, int from, int to, Color color, CardIndices card_indices) override {
+        bot_->pleaseObserveColorHint(server, from, to, color, card_indices);
+    }
+    void pleaseObserveValueHint(const Server &server, int from, int to, Value value, CardIndices card_indices) override {
+        bot_->pleaseObserveValueHint(server, from, to, value, card_indices);
+    }
+    void pleaseObserveAfterMove(const Server &server) override {
+        bot_->pleaseObserveAfterMove(server);
+    }
+    MoveMetrics getMoveMetrics() const override { return bot_->getMoveMetrics(); }
+    void setPermissive(bool permissive) override { bot_->setPermissive(permissive); }
+
+private:
+    int index_;
+    std::vector<MoveSample> *samples_;
+};
+
+Bot *MeteredBotFactory::create(int index, int numPlayers, int handSize) const
+{
+    return new MeteredBot(factory_.create(index, numPlayers, handSize), index, samples_);
+}
+
+void MeteredBotFactory::destroy(Bot *bot) const
+{
+    MeteredBot *metered = static_cast<MeteredBot *>(bot);
+    factory_.destroy(metered->bot_);
+    delete metered;
+}
+
+MetricsWriter::MetricsWriter(const std::string &path, bool append)
+    : out_(path, append ? std::ios::app : std::ios::out)
+{
+    if (!out_) throw std::runtime_error("can't open " + path + " for writing");
+}
+
+void MetricsWriter::writeGame(int game, const GameRecord &record)
+{
+    out_ << "{\"type\": \"game\", \"game\": " << game
+         << ", \"seed\": " << record.seed
+         << ", \"players\": " << record.numPlayers
+         << ", \"score\": " << record.score
+         << ", \"mulligans\": " << record.mulligansUsed
+         << ", \"bomb\": " << (record.mulligansUsed == NUMMULLIGANS ? 1 : 0)
+         << ", \"turns\": " << record.moves.size() << "}\n";
+    out_.flush();
+}
+
+void MetricsWriter::write(int game, const GameRecord &record, const std::vector<MoveSample> &samples)
+{
+    this->writeGame(game, record);
+    /* Each call to pleaseMakeMove() makes exactly one move. */
+    assert(samples.size() == record.moves.size());
+    for (int turn=0; turn < (int)record.moves.size(); ++turn) {
+        const MoveSample &sample = samples[turn];
+        out_ << "{\"type\": \"move\", \"game\": " << game
+             << ", \"turn\": " << turn
+             << ", \"player\": " << sample.player
+             << ", \"move\": \"" << record.moves[turn].toString() << "\""
+             << ", \"latency_ms\": " << sample.latencyMs;
+        if (sample.metrics.beliefRangeSize >= 0) out_ << ", \"belief_range\": " << sample.metrics.beliefRangeSize;
+        if (sample.metrics.beliefBytes >= 0) out_ << ", \"belief_bytes\": " << sample.metrics.beliefBytes;
+        if (sample.metrics.rollouts >= 0) out_ << ", \"rollouts\": " << sample.metrics.rollouts;
+        if (sample.metrics.deviated >= 0) out_ << ", \"deviated\": " << sample.metrics.deviated;
+        out_ << "}\n";
+    }
+    out_.flush();
+}
+
+}  /* namespace Hanabi */
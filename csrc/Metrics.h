@@ -0,0 +1,57 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+
+#pragma once
+
+#include "Hanabi.h"
+#include "GameRecord.h"
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Hanabi {
+
+/* One move of a game, as the evaluation harness saw it. */
+struct MoveSample {
+    int player;
+    double latencyMs;  /* wall-clock time spent in pleaseMakeMove() */
+    MoveMetrics metrics;
+};
+
+/* Makes bots that behave exactly like those of another factory, but
+ * that also time each of their moves and collect the bot's own
+ * MoveMetrics. Every move made by any of its bots is appended to the
+ * same vector of samples, so they come out in the order they were made. */
+class MeteredBotFactory final : public BotFactory {
+public:
+    MeteredBotFactory(const BotFactory &factory, std::vector<MoveSample> *samples)
+        : factory_(factory), samples_(samples) {}
+    Bot *create(int index, int numPlayers, int handSize) const override;
+    void destroy(Bot *bot) const override;
+private:
+    const BotFactory &factory_;
+    std::vector<MoveSample> *samples_;
+};
+
+/* Writes per-game and per-move metrics as JSON lines, e.g.
+ *   {"type": "game", "game": 0, "seed": 12, "players": 2, "score": 24, "mulligans": 1, "bomb": 0, "turns": 61}
+ *   {"type": "move", "game": 0, "turn": 0, "player": 0, "move": "Play 0", "latency_ms": 0.02}
+ * A move line also carries "belief_range", "belief_bytes", "rollouts" and
+ * "deviated" whenever the bot reported them. */
+class MetricsWriter {
+public:
+    /* If append is true, lines are added to the end of an existing file. */
+    explicit MetricsWriter(const std::string &path, bool append = false);
+    void write(int game, const GameRecord &record, const std::vector<MoveSample> &samples);
+    /* Writes just the line for the game, and flushes it to disk. */
+    void writeGame(int game, const GameRecord &record);
+private:
+    std::ofstream out_;
+};
+
+}  /* namespace Hanabi */
@@ -8,6 +8,7 @@
 
 #include "Hanabi.h"
 #include "BotUtils.h"
+#include "Log.h"
 
 struct PyBot : public Hanabi::Bot {
   /* public API */
@@ -20,9 +21,9 @@ struct PyBot : public Hanabi::Bot {
     py_cv_.notify_all();
 
     std::unique_lock<std::mutex> lk(mtx_);
-    std::cerr << "C wait" << std::endl << std::flush;
+    HANABI_LOG(DEBUG, PyBot) << "C wait";
     c_cv_.wait(lk, [this]{ return this->c_wakeup_; });
-    std::cerr << "C wakeup" << std::endl << std::flush;
+    HANABI_LOG(DEBUG, PyBot) << "C wakeup";
   }
 
   void pleaseObserveBeforeMove(const Hanabi::Server &server) override {
@@ -96,9 +97,9 @@ struct PyBot : public Hanabi::Bot {
     c_wakeup_ = true;
     c_cv_.notify_all();
     std::unique_lock<std::mutex> lk(mtx_);
-    std::cerr << "python wait" << std::endl << std::flush;
+    HANABI_LOG(DEBUG, PyBot) << "python wait";
     py_cv_.wait(lk, [this]{ return this->py_wakeup_; }); //
-    std::cerr << "python wakeup" << std::endl << std::flush;
+    HANABI_LOG(DEBUG, PyBot) << "python wakeup";
   }
 
   ~PyBot() override {}
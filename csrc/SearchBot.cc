@@ -14,17 +14,42 @@
 #include <atomic>
 #include <cstring>
 #include "SearchBot.h"
+#include "BeliefKernels.h"
+#include "Log.h"
 #include <thread>
 #include <mutex>
 #include <shared_mutex>
 
 using namespace Hanabi;
 using namespace HanabiParams;
-using namespace SearchBotParams;
 
-namespace SearchBotParams {
-  float SEARCH_THRESH = Params::getParameterFloat("SEARCH_THRESH", 0.1,
-    "Search deviates from the blueprint only if the EV of a move exceeds the blueprint action EV by SEARCH_THRESH.");
+SearchBotParams::SearchBotParams(const Params::Context &params)
+  : BPBOT(params.getString("BPBOT", "SmartBot",
+      "The blueprint agent to use for search."))
+  , SEARCH_PLAYER(params.getInt("SEARCH_PLAYER", -1,
+      "For single-agent search, which player performs search (negative numbers count from the end)."))
+  , SEARCH_ALL(params.getInt("SEARCH_ALL", 0,
+      "If 1, all agents perform search independently (unsound)"))
+  , SEARCH_THRESH(params.getFloat("SEARCH_THRESH", 0.1,
+      "Search deviates from the blueprint only if the EV of a move exceeds the blueprint action EV by SEARCH_THRESH."))
+  , SEARCH_N(params.getInt("SEARCH_N", 10000,
+      "Number of MC rollouts to perform for search."))
+  , DOUBLE_SEARCH(params.getInt("DOUBLE_SEARCH", 0,
+      "Perform a second (independent) search to use as an unbiased estimator of the true scores."))
+  , PARTNER_UNIFORM_UNC(params.getFloat("PARTNER_UNIFORM_UNC", 0.,
+      "Add 'uniform' uncertainty to the belief update. Should be 0-1, with 1 corresponding to assuming a uniform policy."))
+  , PARTNER_BOLTZMANN_UNC(params.getFloat("PARTNER_BOLTZMANN_UNC", 0.,
+      "Assume the TorchBot partner plays a Boltzmann distribution of actions proportional to exp(Q_a / T), where T is chosen so the 'best' action is played with probability 1-unc. (TorchBot only)."))
+  , OPTIMIZE_WINS(params.getInt("OPTIMIZE_WINS", 0,
+      "Have search ptimize for wins (25 points) rather than max score. This tends to produce worse scores *and* fewer wins, due to bad reward shaping."))
+  , UCB(params.getInt("UCB", 1,
+      "Use UCB for search MC rollouts."))
+  , SEARCH_BASELINE(params.getInt("SEARCH_BASELINE", 0,
+      "If 1, subtract blueprint action EV from EVs for other actions during MC rollouts; reduces the number of MC rollouts required."))
+  , DELAYED_OBS_THRESH(params.getInt("DELAYED_OBS_THRESH", 100000,
+      "Only apply observations to belief bots if the range is below this size. For TorchBot, this trades off time vs space "
+      "(higher THRESH uses less memory at the cost of more compute)."))
+{
 }
 
 static void _registerBots() {
@@ -34,44 +59,43 @@ static void _registerBots() {
 static int dummy =  (_registerBots(), 0);
 
 
-void applyDelayedObservations(HandDist &handDist, const std::vector<BoxedHand> &handDistKeys) {
-  if (handDist.size() > DELAYED_OBS_THRESH) {
+void applyDelayedObservations(HandDist &handDist, const SearchBotParams &params) {
+  if (handDist.size() > params.DELAYED_OBS_THRESH) {
     // bail to save memory
     return;
   }
   std::vector<boost::fibers::future<void>> futures;
-  std::cerr << now() << "Applying "
-    << handDist[handDistKeys[0]].delayed_observations.size() << " observations to "
-    << handDistKeys.size() << " bots." << std::endl;
+  HANABI_LOG(DEBUG, SearchBot) << "Applying "
+    << handDist.val(0).delayed_observations.size() << " observations to "
+    << handDist.size() << " bots.";
 
   for (int t = 0; t < NUM_THREADS; t++) {
     futures.push_back(getThreadPool().enqueue([&, t]() {
-      for (int i = t; i < handDistKeys.size(); i += NUM_THREADS) {
-        auto key = handDistKeys[i];
-        handDist.at(key).applyObservations();
+      for (size_t i = t; i < handDist.size(); i += NUM_THREADS) {
+        handDist.val(i).applyObservations();
       }
     }));
   }
   for (auto &f: futures) {
     f.get();
   }
-  std::cerr << now() << "Done applying delayed observations." << std::endl;
+  HANABI_LOG(DEBUG, SearchBot) << "Done applying delayed observations.";
 }
 
 
 SearchBot::SearchBot(int index, int numPlayers, int handSize) : simulserver_(numPlayers)
 {
-  std::cerr << now() << "SearchBotParams {" << std::endl; // legacy
+  HANABI_LOG(INFO, SearchBot) << "SearchBotParams {"; // legacy
 
   me_ = index;
   last_move_ = std::vector<Move>(numPlayers, Move());
-  std::cerr << now() << "Initializing sub-bots..." << std::endl;
-  auto botFactory = getBotFactory(SearchBotParams::BPBOT);
+  HANABI_LOG(INFO, SearchBot) << "Initializing sub-bots...";
+  auto botFactory = getBotFactory(params_.BPBOT);
 
   for (int player = 0; player < numPlayers; player++) {
     auto bot = botFactory->create(player, numPlayers, handSize);
-    if (PARTNER_BOLTZMANN_UNC > 0 && player != me_) {
-      bot->setActionUncertainty(PARTNER_BOLTZMANN_UNC);
+    if (params_.PARTNER_BOLTZMANN_UNC > 0 && player != me_) {
+      bot->setActionUncertainty(params_.PARTNER_BOLTZMANN_UNC);
     }
     players_.push_back(std::shared_ptr<Bot>(bot));
     players_.back()->setPermissive(true); // because we may not follow the blueprint
@@ -79,32 +103,81 @@ SearchBot::SearchBot(int index, int numPlayers, int handSize) : simulserver_(num
   simulserver_.setPlayers(players_);
 }
 
-void SearchBot::populateInitialHandDistribution_(Hand &hand, float prob, DeckComposition &deck, int handSize, int who, HandDist &handDist, const BotVec &partners) {
-  // This function recursively populates a hand distribution with all possible
-  // five-card hands composed of the provided deck composition.
-  if (hand.size() == 0) {
-    hand.reserve(handSize);
-  }
+SearchBot::~SearchBot()
+{
+  // a subclass's beliefs are gone by now too, so this returns all of them
+  hand_distribution_ = HandDist();
+  releaseFreedMemory();
+}
+
+static void enumerateHands_(Hand &hand, DeckComposition &deck, int handSize, std::vector<PackedHand> &hands) {
+  // This function recursively enumerates all possible hands of handSize
+  // cards composed of the provided deck composition.
   if (hand.size() == handSize) {
-    if (handDist.size() % 1000000 == 0) {
-      std::cerr << now() << "Generated " << handDist.size() << " hands." << std::endl;
+    if (hands.size() % 1000000 == 0) {
+      HANABI_LOG(INFO, SearchBot) << "Generated " << hands.size() << " hands.";
     }
-    // assert(handDist.count(hand) == 0);
-    handDist[hand] = HandDistVal(prob, partners);
+    hands.push_back(packHand(hand));
     return;
   }
 
-  for (auto &kv : deck) {
-    const Card &card = kv.first;
-    int count = kv.second;
-    if (count > 0) {
-      deck[card]--;
-      hand.push_back(card);
-      populateInitialHandDistribution_(hand, prob * count, deck, handSize, who, handDist, partners);
+  for (int i = 0; i < DeckComposition::NUMCARDS; i++) {
+    if (deck.counts[i] > 0) {
+      deck.counts[i]--;
+      hand.push_back(indexToCard(i));
+      enumerateHands_(hand, deck, handSize, hands);
       hand.pop_back();
-      deck[card]++;
+      deck.counts[i]++;
+    }
+  }
+}
+
+const std::vector<PackedHand> &SearchBot::initialHands(int handSize) {
+  static std::mutex mutex;
+  static std::map<int, std::unique_ptr<const std::vector<PackedHand>>> cache;
+  std::lock_guard<std::mutex> lock(mutex);
+  auto &hands = cache[handSize];
+  if (!hands) {
+    DeckComposition deck;
+    for (int i = 0; i < DeckComposition::NUMCARDS; i++) {
+      deck.counts[i] = indexToCard(i).count();
     }
+    std::unique_ptr<std::vector<PackedHand>> all(new std::vector<PackedHand>());
+    Hand hand;
+    enumerateHands_(hand, deck, handSize, *all);
+    std::sort(all->begin(), all->end());
+    hands = std::move(all);
   }
+  return *hands;
+}
+
+void SearchBot::warmUp(int numPlayers, int handSize) {
+  const SearchBotParams params;
+  Hanabi::getBotFactory(params.BPBOT)->warmUp(numPlayers, handSize);
+  initialHands(handSize);
+}
+
+void SearchBot::populateInitialHandDistribution_(const DeckComposition &deck, int handSize, HandDist &handDist, const BotVec &partners) {
+  auto shared_partners = std::make_shared<const BotVec>(partners);
+  const std::vector<PackedHand> &hands = initialHands(handSize);
+  handDist.reserve(hands.size());
+  for (PackedHand packed : hands) {
+    const Hand hand = unpackHand(packed);
+    // the probability of dealing this hand from deck, card by card
+    float prob = 1;
+    for (int i = 0; i < handSize && prob > 0; i++) {
+      int count = deck[hand[i]];
+      for (int j = 0; j < i; j++) {
+        if (hand[j] == hand[i]) count--;
+      }
+      prob *= std::max(count, 0);
+    }
+    if (prob > 0) {
+      // initialHands is in HandDist order, so this keeps it sorted
+      handDist.push_back(packed, prob, HandDistVal(shared_partners));
+    }
+  }
+  handDist.sort();
 }
 
 void SearchBot::applyToAll(ObservationFunc f) {
@@ -115,12 +188,12 @@ void SearchBot::init_(const Server &server) {
   // we have to generate the initial hand distribution here rather than in the constructor
   // because we need access to the server to know what the partner hand is
   assert(hand_distribution_.empty());
-  std::cerr << now() << "Generating initial hand distribution..." << std::endl;
+  HANABI_LOG(INFO, SearchBot) << "Generating initial hand distribution...";
   DeckComposition deck = getCurrentDeckComposition(server, me_);
-  Hand hand;
   auto partners = cloneBotVec(players_, me_);
-  populateInitialHandDistribution_(hand, 1, deck, server.handSize(), me_, hand_distribution_, partners);
-  std::cerr << now() << "Hand distribution contains " << hand_distribution_.size() << " hands." << std::endl;
+  populateInitialHandDistribution_(deck, server.handSize(), hand_distribution_, partners);
+  HANABI_LOG(INFO, SearchBot) << "Hand distribution contains " << hand_distribution_.size() << " hands ("
+    << hand_distribution_.memoryUsage() / (1 << 20) << " MB).";
 }
 
 void SearchBot::pleaseObserveBeforeMove(const Server &server) {
@@ -133,11 +206,11 @@ void SearchBot::pleaseObserveBeforeMove(const Server &server) {
 
   assert(server.whoAmI() == me_);
   simulserver_.sync(server);
-  std::cerr << now() << "applyToAll ObserveBeforeMove start" << std::endl;
+  HANABI_LOG(DEBUG, SearchBot) << "applyToAll ObserveBeforeMove start";
   applyToAll(
     [](Bot *bot, const Server &server) { bot->pleaseObserveBeforeMove(server); }
   );
-  std::cerr << now() << "applyToAll ObserveBeforeMove end" << std::endl;
+  HANABI_LOG(DEBUG, SearchBot) << "applyToAll ObserveBeforeMove end";
 
 }
 
@@ -208,15 +281,16 @@ void SearchBot::pleaseObserveAfterMove(const Server &server) {
       bot->pleaseObserveAfterMove(server); }
   );
   if(server.gameOver() || server.finalCountdown() == server.numPlayers()) {
+    // on stdout, in this format, just before the game's final score:
+    // accum_scores.py reads the gain from it
     std::cout << "SearchBot changed " << changed_moves_ << " moves, gaining ";
-    if (DOUBLE_SEARCH) {
+    if (params_.DOUBLE_SEARCH) {
       std::cout << unbiased_score_difference_ << " (unbiased) " << score_difference_ << " (biased) ";
       std::cout << "Win delta: " << unbiased_win_difference_ << " (unbiased) ";
     } else {
       std::cout << score_difference_;
     }
     std::cout << " points. Total search iters: " << total_iters_ << std::endl;
-
   }
 }
 
@@ -242,31 +316,18 @@ void SearchBot::filterBeliefsConsistentWithHint_(
     HandDist &handDist,
     const CardIndices *relevant_indices) const {
 
-  auto hand_dist_keys = copyKeys(handDist);
   auto old_size = handDist.size();
-  for (auto &hand : hand_dist_keys) {
-    bool keep = true;
-    for (int i = 0; i < hand.size(); i++) {
-      if (relevant_indices && !relevant_indices->contains(i)) {
-        continue;
-      }
-      const Card &card = hand[i];
-      int card_value = move.type == HINT_COLOR ? (int) card.color : (int) card.value;
-      bool consistent = card_indices.contains(i) ?
-                        card_value == move.value :  // positive info
-                        card_value != move.value;   // negative info
-      if (!consistent) {
-        keep = false;
-        break;
-      }
-    }
-    if (!keep) {
-      handDist.erase(hand);
-    }
-  }
-  std::cerr << now() << "Player " << me_ << ": Filtered beliefs consistent with hint " << move.toString()
+  // the touched cards have the hinted color or value (positive info), and
+  // the other relevant ones don't (negative info)
+  const unsigned touched = cardIndicesMask(card_indices);
+  const unsigned relevant = relevant_indices ? cardIndicesMask(*relevant_indices) : ~0u;
+  handDist.filterBlocks([&](size_t begin, size_t end, uint8_t *keep) {
+    hintConsistentHands(handDist.packedHands() + begin, end - begin, move.type == HINT_COLOR, move.value,
+                        touched, relevant, keep);
+  });
+  HANABI_LOG(DEBUG, SearchBot) << "Player " << me_ << ": Filtered beliefs consistent with hint " << move.toString()
             << " reduced from " << old_size << " to " <<
-            handDist.size() << std::endl;
+            handDist.size();
 }
 
 void SearchBot::filterBeliefsConsistentWithAction_(const Move &move, int from, const Server &server) {
@@ -274,43 +335,42 @@ void SearchBot::filterBeliefsConsistentWithAction_(const Move &move, int from, c
     return;
   }
 
-  {
+  if (HANABI_LOG_IS_ON(DEBUG, SearchBot)) {
     // just for logging
     auto cheat_hand = server.cheatGetHand(me_);
-    auto cheat_bot = hand_distribution_[cheat_hand].getPartner(from);
+    auto cheat_bot = hand_distribution_.val(hand_distribution_.find(cheat_hand)).getPartner(from);
     auto cheat_server = SimulServer(server);
     cheat_server.setHand(me_, cheat_hand);
     auto expected_move = cheat_server.simulatePlayerMove(from, cheat_bot->clone());
-    std::cerr << "SearchBot expected " << expected_move.toString() << " , observed " << move.toString() << std::endl;
+    HANABI_LOG(DEBUG, SearchBot) << "SearchBot expected " << expected_move.toString() << " , observed " << move.toString();
   }
 
-  if (PARTNER_UNIFORM_UNC == 1) {
+  if (params_.PARTNER_UNIFORM_UNC == 1) {
     return;
   }
   size_t old_size = hand_distribution_.size();
-  std::cerr << now() << "filterAction_ with " << old_size << " beliefs." << std::endl;
-  auto hand_dist_keys = copyKeys(hand_distribution_);
-  applyDelayedObservations(hand_distribution_, hand_dist_keys);
+  HANABI_LOG(DEBUG, SearchBot) << "filterAction_ with " << old_size << " beliefs.";
+  applyDelayedObservations(hand_distribution_, params_);
   std::vector<boost::fibers::future<void>> futures;
   for (int t = 0; t < NUM_THREADS; t++) {
     futures.push_back(getThreadPool().enqueue([&, t]() {
       SimulServer simulserver(simulserver_);
-      for (int i = t; i < hand_dist_keys.size(); i += NUM_THREADS) {
-        auto &hand = hand_dist_keys[i];
+      for (size_t i = t; i < hand_distribution_.size(); i += NUM_THREADS) {
+        const Hand hand = hand_distribution_.hand(i);
         simulserver.setHand(me_, hand);
-        auto bot = hand_distribution_[hand].getPartner(from);
-        if (PARTNER_BOLTZMANN_UNC > 0) {
+        auto bot = hand_distribution_.val(i).getPartner(from);
+        if (params_.PARTNER_BOLTZMANN_UNC > 0) {
           auto action_probs = bot->getActionProbs();
-          if (server.cheatGetHand(me_) == hand.get()) {
-            for (auto kv : action_probs) std::cerr << "Action " << kv.first << " : " <<kv.second << std::endl;
-            std::cerr << "Prob of " << move.toString() << " ( " << moveToIndex(move, server) << ") : " << action_probs[moveToIndex(move, server)] << std::endl;
+          if (server.cheatGetHand(me_) == hand) {
+            for (auto kv : action_probs) HANABI_LOG(DEBUG, SearchBot) << "Action " << kv.first << " : " <<kv.second;
+            HANABI_LOG(DEBUG, SearchBot) << "Prob of " << move.toString() << " ( " << moveToIndex(move, server) << ") : " << action_probs[moveToIndex(move, server)];
           }
-          hand_distribution_[hand].prob *= (action_probs[moveToIndex(move, server)] + PARTNER_UNIFORM_UNC);
+          hand_distribution_.prob(i) *= (action_probs[moveToIndex(move, server)] + params_.PARTNER_UNIFORM_UNC);
         } else {
           Move cf_move = simulserver.simulatePlayerMove(from, bot.get());
 
           if (move != cf_move) {
-            hand_distribution_[hand].prob *= PARTNER_UNIFORM_UNC;
+            hand_distribution_.prob(i) *= params_.PARTNER_UNIFORM_UNC;
           }
         }
       }
@@ -319,14 +379,10 @@ void SearchBot::filterBeliefsConsistentWithAction_(const Move &move, int from, c
   for (auto &f: futures) {
     f.get();
   }
-  for (auto &hand: hand_dist_keys) {
-    if (hand_distribution_[hand].prob == 0) {
-      hand_distribution_.erase(hand);
-    }
-  }
-  std::cerr << now() << "Player " << me_ << ": Filtered beliefs consistent with player " << from << " action '" << move.toString()
+  hand_distribution_.eraseZeroProb();
+  HANABI_LOG(DEBUG, SearchBot) << "Player " << me_ << ": Filtered beliefs consistent with player " << from << " action '" << move.toString()
             << "' reduced from " << old_size << " to " <<
-            hand_distribution_.size() << std::endl;
+            hand_distribution_.size();
 
   checkBeliefs_(server);
 }
@@ -339,8 +395,6 @@ void SearchBot::updateBeliefsFromDraw_(int who, int card_index, Card played_card
     updateBeliefsFromRevealedCard_(me_, drawn_card, server, hand_distribution_);
   }
   checkBeliefs_(server);
-
-  DeckComposition deck = getCurrentDeckComposition(server, -1);
 }
 
 void SearchBot::updateBeliefsFromMyDraw_(
@@ -354,8 +408,8 @@ void SearchBot::updateBeliefsFromMyDraw_(
   HandDist new_hand_distribution;
   DeckComposition deck = getCurrentDeckComposition(server, public_beliefs ? -1 : who);
   int hand_size = server.sizeOfHandOfPlayer(who);
-  for (auto &kv : handDist) {
-    const Hand &hand = kv.first;
+  for (size_t h = 0; h < handDist.size(); h++) {
+    const Hand hand = handDist.hand(h);
     //std::cerr << now() << "MyDraw_: " << handAsString(hand) << std::endl;
     if (hand[card_index] != played_card) {
       //std::cerr << now() << "pruned : (" << card_index << ") " << hand[card_index].toString() << " != " << played_card.toString() << std::endl;
@@ -373,16 +427,15 @@ void SearchBot::updateBeliefsFromMyDraw_(
 
     if (server.sizeOfHandOfPlayer(who) == server.handSize()) {
       // update distribution with all possible drawn cards
-      for (const auto &kv2 : deck) {
-        const Card &card = kv2.first;
-        int count = kv2.second;
+      for (int j = 0; j < DeckComposition::NUMCARDS; j++) {
+        const Card card = indexToCard(j);
+        int count = deck.counts[j];
         //std::cerr << now() << "Added card: " << card.toString() << " with count " << count << std::endl;
 
         if (count > 0) {
           new_hand.push_back(card);
           assert(new_hand.size() == hand_size);
-          assert(new_hand_distribution.count(new_hand) == 0);
-          new_hand_distribution[new_hand] = kv.second;
+          new_hand_distribution.push_back(packHand(new_hand), handDist.prob(h), handDist.val(h));
 
           //std::cerr << now() << "new hand: " << handAsString(new_hand) << std::endl;
 
@@ -393,15 +446,17 @@ void SearchBot::updateBeliefsFromMyDraw_(
       // no new card drawn, just keep your old hand
       assert(server.cardsRemainingInDeck() == 0 || server.gameOver());
       assert(new_hand.size() == hand_size);
-      new_hand_distribution[new_hand] = kv.second;
+      new_hand_distribution.push_back(packHand(new_hand), handDist.prob(h), handDist.val(h));
     }
     addToDeck(new_hand, deck);
 
   }
-  std::cerr << now() << "Player " << me_ << ": Filtered player " << who << " beliefs consistent with my draw; went from "
+  // the new hands are distinct, but no longer in order
+  new_hand_distribution.sort();
+  HANABI_LOG(DEBUG, SearchBot) << "Player " << me_ << ": Filtered player " << who << " beliefs consistent with my draw; went from "
             << handDist.size() << " to " <<
-            new_hand_distribution.size() << std::endl;
-  handDist = new_hand_distribution;
+            new_hand_distribution.size();
+  handDist = std::move(new_hand_distribution);
 }
 
 void SearchBot::updateBeliefsFromRevealedCard_(
@@ -416,27 +471,16 @@ void SearchBot::updateBeliefsFromRevealedCard_(
   int remaining = deck[revealed_card] + 1; // this is what was remaining *before* the draw
   assert(remaining > 0);
   int old_size = handDist.size();
-  auto hand_dist_keys = copyKeys(handDist);
-  for (auto &hand: hand_dist_keys) {
-    int in_hand = 0;
-    for (int i = 0; i < hand.size(); i++) {
-      const Card &my_card = hand[i];
-      if (relevant_indices && !relevant_indices->contains(i)) continue;
-      if (my_card == revealed_card) in_hand++;
-    }
-    if (in_hand > 0) {
-      auto &val = handDist[hand];
-      float new_prob = val.prob * (remaining - in_hand) / remaining;
-      if (new_prob > 0) {
-        val.prob = new_prob;
-      } else {
-        handDist.erase(hand);
-      }
-    }
-  }
-  std::cerr << now() << "Player " << me_ << ": Filtered player " << who << " beliefs consistent with revealed card " << revealed_card.toString()
+  // a hand with k copies of the card (in the relevant positions) was dealt
+  // from a deck with k fewer of them
+  const unsigned relevant = relevant_indices ? cardIndicesMask(*relevant_indices) : ~0u;
+  handDist.filterBlocks([&](size_t begin, size_t end, uint8_t *keep) {
+    reweightHandsForRevealedCard(handDist.packedHands() + begin, end - begin, revealed_card, remaining,
+                                 relevant, handDist.probs() + begin, keep);
+  });
+  HANABI_LOG(DEBUG, SearchBot) << "Player " << me_ << ": Filtered player " << who << " beliefs consistent with revealed card " << revealed_card.toString()
             << " reduced from " << old_size << " to " <<
-            handDist.size() << std::endl;
+            handDist.size();
 }
 
 void SearchBot::checkBeliefs_(const Server &server) const {
@@ -446,22 +490,24 @@ void SearchBot::checkBeliefs_(const Server &server) const {
 void SearchBot::checkBeliefs_(const Server &server, int who, const HandDist &handDist, const Hand &trueHand) const {
 
   if (handDist.count(trueHand) == 0) {
-    std::cerr << now() << "ERROR: player's true hand not contained in beliefs" << std::endl;
-    std::cerr << now() << "Who am I? " << who << std::endl;
-    std::cerr << now() << "true hand: " << handAsString(trueHand) << std::endl;
-    std::cerr << now() << "Hands: " << server.handsAsString() << std::endl;
-    std::cerr << now() << "Discards: " << server.discardsAsString() << std::endl;
-    std::cerr << now() << "Piles: " << server.pilesAsString() << std::endl;
-    std::cerr << now() << "-------------------------" << std::endl;
-    std::cerr << now() << "Hand distribution: (count= " << handDist.size() << ")" << std::endl;
+    std::ostringstream out;
+    out << "ERROR: player's true hand not contained in beliefs" << std::endl;
+    out << "Who am I? " << who << std::endl;
+    out << "true hand: " << handAsString(trueHand) << std::endl;
+    out << "Hands: " << server.handsAsString() << std::endl;
+    out << "Discards: " << server.discardsAsString() << std::endl;
+    out << "Piles: " << server.pilesAsString() << std::endl;
+    out << "-------------------------" << std::endl;
+    out << "Hand distribution: (count= " << handDist.size() << ")";
     int count = 0;
-    for (auto &kv : handDist) {
-      std::cerr << now() << handAsString(kv.first) << std::endl;
+    for (size_t i = 0; i < handDist.size(); i++) {
+      out << std::endl << handAsString(handDist.hand(i));
       if (count++ > 100) {
-        std::cerr << now() << "..." << std::endl;
+        out << std::endl << "...";
         break;
       }
     }
+    HANABI_LOG(ERROR, SearchBot) << out.str();
     throw std::runtime_error("Belief check failed.");
   } else {
     // std::cerr << now() << "CheckBeliefs: Found player " << who << " true hand " << handAsString(trueHand) << " among " << handDist.size() << " beliefs." << std::endl;
@@ -471,35 +517,35 @@ void SearchBot::checkBeliefs_(const Server &server, int who, const HandDist &han
 
 static std::uniform_real_distribution<double> real_dist(0., 1.);
 
-Hand sampleFromCDF_(const HandDistCDF &cdf, std::mt19937 &gen) {
+// returns the index of the sampled hand in cdf (and its HandDist)
+size_t sampleFromCDF_(const HandDistCDF &cdf, std::mt19937 &gen) {
 
   double prob = real_dist(gen);
   auto it = std::upper_bound(cdf.probs.begin(), cdf.probs.end(), prob);
   int idx = it - cdf.probs.begin() - 1;
   if (idx >= cdf.hands.size())  {
-    std::cerr << now() << "CDF uhoh: " << idx << " >= " << cdf.hands.size() << " [ "
-        << cdf.probs.size() << " " << cdf.probs.back() << " " << prob << std::endl;
+    HANABI_LOG(ERROR, SearchBot) << "CDF uhoh: " << idx << " >= " << cdf.hands.size() << " [ "
+        << cdf.probs.size() << " " << cdf.probs.back() << " " << prob;
     assert(0);
   }
-  Hand hand = cdf.hands[idx];
   assert(cdf.probs[idx + 1] - cdf.probs[idx] > 0 || idx + 1 == cdf.probs.size());
   // std::cerr << now() << "Got prob " << prob << " sampled idx " << idx << " i.e. hand " << handAsString(hand) << " cdf: " << cdf.probs[idx] << std::endl;
-  return hand;
+  return idx;
 }
 
-bool canPruneMove(const SearchStats &stats, Move move, Move bp_move) {
-  if (SEARCH_BASELINE && move == bp_move) {
+bool canPruneMove(const SearchStats &stats, Move move, Move bp_move, const SearchBotParams &params) {
+  if (params.SEARCH_BASELINE && move == bp_move) {
     return false;
   }
 
-  if (!UCB) {
+  if (!params.UCB) {
     return false;
   }
 
   const UCBStats &this_ucb = stats.at(move);
 
   Move best_move(INVALID_MOVE, 0);
-  if (SEARCH_BASELINE) {
+  if (params.SEARCH_BASELINE) {
     double best_stderr = 0;
     double best_mean = -100;
     for (auto &kv: stats) {
@@ -534,10 +580,10 @@ bool canPruneMove(const SearchStats &stats, Move move, Move bp_move) {
 
 
 
-std::string oneMoveStatToString(const SearchStats &stats, Move m) {
+std::string oneMoveStatToString(const SearchStats &stats, Move m, const SearchBotParams &params) {
   if(stats.count(m)) {
     char buff[100];
-    if (SEARCH_BASELINE) {
+    if (params.SEARCH_BASELINE) {
       snprintf(buff, sizeof(buff), "%6.2f +/- %4.2g (%4d)",
         stats.at(m).mean,
         ((float)((int) (stats.at(m).search_baseline_stderr() * 100))) / 100, stats.at(m).N);
@@ -553,34 +599,36 @@ std::string oneMoveStatToString(const SearchStats &stats, Move m) {
   }
 }
 
-void logSearchResults(const SearchStats &stats, int numPlayers, int me) {
-  std::cerr << now() << "Play:            ";
+void logSearchResults(const SearchStats &stats, int numPlayers, int me, const SearchBotParams &params) {
+  if (!HANABI_LOG_IS_ON(INFO, SearchBot)) return;
+  std::ostringstream out;
+  out << "Play:            ";
   for (int i = 0; i < 5; i++) {
-    std::cerr << i << ": ";
-    std::cerr << oneMoveStatToString(stats, Move(PLAY_CARD, i)) << " ";
+    out << i << ": ";
+    out << oneMoveStatToString(stats, Move(PLAY_CARD, i), params) << " ";
   }
-  std::cerr << std::endl;
-  std::cerr << now() << "Discard:         ";
+  out << std::endl;
+  out << "Discard:         ";
   for (int i = 0; i < 5; i++) {
-    std::cerr << i << ": ";
-    std::cerr << oneMoveStatToString(stats, Move(DISCARD_CARD, i)) << " ";
+    out << i << ": ";
+    out << oneMoveStatToString(stats, Move(DISCARD_CARD, i), params) << " ";
   }
-  std::cerr << std::endl;
   for (int to = 0; to < numPlayers; to++) {
     if (to == me) continue;
-    std::cerr << now() << "Hint Color to " << to << ": ";
+    out << std::endl;
+    out << "Hint Color to " << to << ": ";
     for (Color color = RED; color < NUMCOLORS; color++) {
-      std::cerr << colorname(color)[0] << ": ";
-      std::cerr << oneMoveStatToString(stats, Move(HINT_COLOR, color, to)) << " ";
+      out << colorname(color)[0] << ": ";
+      out << oneMoveStatToString(stats, Move(HINT_COLOR, color, to), params) << " ";
     }
-    std::cerr << std::endl;
-    std::cerr << now() << "Hint Value to " << to << ": ";
+    out << std::endl;
+    out << "Hint Value to " << to << ": ";
     for (Value value = ONE; value <= VALUE_MAX; value++) {
-      std::cerr << value << ": ";
-      std::cerr << oneMoveStatToString(stats, Move(HINT_VALUE, value, to)) << " ";
+      out << value << ": ";
+      out << oneMoveStatToString(stats, Move(HINT_VALUE, value, to), params) << " ";
     }
-    std::cerr << std::endl;
   }
+  HANABI_LOG(INFO, SearchBot) << out.str();
 }
 
 
@@ -634,24 +682,28 @@ int oneSearchIter_(
   const HandDistCDF &cdf,
   const Server &server,
   const HandDist &handDist,
-  std::mt19937 &gen
+  std::mt19937 &gen,
+  RolloutServer &search_server
 ){
   // pick a hand from the beliefs, and a move, and a deck
-  Hand sampled_hand = sampleFromCDF_(cdf, gen);
+  assert(cdf.hands.size() == handDist.size());
+  size_t sampled = sampleFromCDF_(cdf, gen);
+  Hand sampled_hand = unpackHand(cdf.hands[sampled]);
 
   // sample a deck
   DeckComposition search_deck = getCurrentDeckComposition(server, who);
   removeFromDeck(sampled_hand, search_deck);
-  std::vector<Card> deck_order;
-  for(auto kv : search_deck) {
-    for (int i = 0; i < kv.second; i++) deck_order.push_back(kv.first);
+  DeckArray deck_order;
+  for (int c = 0; c < DeckComposition::NUMCARDS; c++) {
+    for (int i = 0; i < search_deck.counts[c]; i++) deck_order.push_back(indexToCard(c));
   }
   portable_shuffle(deck_order.begin(), deck_order.end(), gen);
 
-  // setup server
-  SimulServer search_server(server);
+  // setup server; search_server is a fork of server that we reuse across
+  // rollouts, undoing each one when we're done with it
+  auto root = search_server.checkpoint();
 
-  auto &distval = handDist.at(sampled_hand);
+  auto &distval = handDist.val(sampled);
   BotVec search_bots;
   for(int p = 0; p < server.numPlayers(); p++) {
     if (p == who) search_bots.push_back(std::shared_ptr<Bot>(me_bot->clone()));
@@ -680,23 +732,24 @@ int oneSearchIter_(
   // simulate!
   int score = search_server.runToCompletion();
 
+  search_server.rollbackTo(root);
   return score;
 }
 
 
-inline void accumScore(int score, int bp_score, Move &move, SearchStats &stats, SearchStats *win_stats) {
+inline void accumScore(int score, int bp_score, Move &move, SearchStats &stats, SearchStats *win_stats, const SearchBotParams &params) {
   if (score == -1) { // skipped
     return;
   }
   assert(score >= 0);
 
   int adj_score = score;
-  if (SEARCH_BASELINE) {
+  if (params.SEARCH_BASELINE) {
     assert(bp_score >= 0);
     adj_score = score - bp_score;
   }
 
-  stats[move].add(OPTIMIZE_WINS ? (score == 25 ? 1 : 0) : adj_score);
+  stats[move].add(params.OPTIMIZE_WINS ? (score == 25 ? 1 : 0) : adj_score);
   if (win_stats) {
     (*win_stats)[move].add(score == 25);
   }
@@ -719,17 +772,17 @@ Move SearchBot::doSearch_(
   // slow to update them for public -> private conversion. The probabilities in
   // cdf are considered the ground truth for the purposes of search
 
-  std::vector<Move> moves = enumerateLegalMoves(server);
+  MoveList moves = enumerateLegalMoves(server);
   int num_moves = moves.size();
 
   for (auto &move : moves) {
     stats[move] = UCBStats();
     if (win_stats) (*win_stats)[move] = UCBStats();
   }
-  stats[bp_move].bias = SEARCH_THRESH;
+  stats[bp_move].bias = params_.SEARCH_THRESH;
   std::atomic<int> loop_count(0);
   if (verbose) {
-    std::cerr << now() << "search player " << server.whoAmI() << " start" << std::endl;
+    HANABI_LOG(INFO, SearchBot) << "search player " << server.whoAmI() << " start";
   }
 
   bool frame_bail = false;
@@ -737,10 +790,10 @@ Move SearchBot::doSearch_(
   int bp_mi = -1;
   int frame_mi = -1;
   for (int mi = 0; mi < num_moves; mi++) {
-    if (moves.at(mi) == bp_move) {
+    if (moves[mi] == bp_move) {
       bp_mi = mi;
     }
-    if (frame_move != Move() && moves.at(mi) == frame_move) {
+    if (frame_move != Move() && moves[mi] == frame_move) {
       frame_mi = mi;
     }
   }
@@ -750,20 +803,21 @@ Move SearchBot::doSearch_(
   assert(temp_num_threads >= num_moves);
 
   //std::cerr << "Temporary number of threads: " << temp_num_threads << std::endl;
-  int temp_search_n = SEARCH_N - (SEARCH_N % temp_num_threads);
+  int temp_search_n = params_.SEARCH_N - (params_.SEARCH_N % temp_num_threads);
 
   std::vector<boost::fibers::future<void>> futures;
   std::mutex mtx;
   Barrier barrier(temp_num_threads);
 
   std::uniform_int_distribution<int> uid1(0, 1 << 30);
-  std::vector<int> seeds(SEARCH_N / num_moves + 1);
+  std::vector<int> seeds(params_.SEARCH_N / num_moves + 1);
   for(int i = 0; i < seeds.size(); i++) seeds[i] = uid1(gen);
 
-  std::vector<int> scores(SEARCH_N, -2);
+  std::vector<int> scores(params_.SEARCH_N, -2);
   int accumed = 0;
   for (int t = 0; t < temp_num_threads; t++) {
     futures.push_back(getThreadPool().enqueue([&, t](){
+      RolloutServer search_server(server);
       for (int j = t; j < temp_search_n; j += temp_num_threads) {
         if (frame_bail || prune_count >= num_moves - 1) {
           break;
@@ -773,31 +827,31 @@ Move SearchBot::doSearch_(
         int mi = j % num_moves;
         int g = j / num_moves;
         if (seeds[g] == 0) {
-          std::cerr << "WARNING: seed is 0!\n";
+          HANABI_LOG(WARN, SearchBot) << "seed is 0!";
         }
         assert(g < seeds.size());
         std::mt19937 my_gen(seeds[g]);
 
-        auto sampled_move = moves.at(mi);
+        auto sampled_move = moves[mi];
         if (!stats[sampled_move].pruned) {
           loop_count++;
-          scores[j] = oneSearchIter_(me_bot, who, sampled_move, cdf, server, handDist, my_gen);
+          scores[j] = oneSearchIter_(me_bot, who, sampled_move, cdf, server, handDist, my_gen, search_server);
          } else {
           scores[j] = -1; // sentinel
         }
 
         // single-threaded stuff
-        if (UCB && j + temp_num_threads < temp_search_n) {
+        if (params_.UCB && j + temp_num_threads < temp_search_n) {
           barrier.wait();
 
           if (t == 0) {
             for (int k = j; k < j + temp_num_threads; k++) {
               int bp_score = scores[k - (k % num_moves) + bp_mi];
-              accumScore(scores[k], bp_score, moves[k % num_moves], stats, win_stats);
+              accumScore(scores[k], bp_score, moves[k % num_moves], stats, win_stats, params_);
             }
 
             for (int mi = 0; mi < num_moves; mi++) {
-              if (!stats[moves[mi]].pruned && canPruneMove(stats, moves[mi], bp_move)) {
+              if (!stats[moves[mi]].pruned && canPruneMove(stats, moves[mi], bp_move, params_)) {
                 stats[moves[mi]].pruned = true;
                 prune_count++;
                 if (moves[mi] == frame_move) {
@@ -822,7 +876,7 @@ Move SearchBot::doSearch_(
   if (prune_count < num_moves - 1) { // accumulate the stragglers
     for (int k = accumed; k < temp_search_n; k++) {
       int bp_score = scores[k - (k % num_moves) + bp_mi];
-      accumScore(scores[k], bp_score, moves[k % num_moves], stats, win_stats);
+      accumScore(scores[k], bp_score, moves[k % num_moves], stats, win_stats, params_);
     }
   }
 
@@ -837,8 +891,8 @@ Move SearchBot::doSearch_(
     }
   }
   if (verbose) {
-    std::cerr << now() << "Ran " << loop_count << " search iters over " << num_moves << " moves. ( " << server.handsAsString()
-              << " ) , p " << server.whoAmI() << " --> " << best_move.toString() << " (" << stats[best_move].mean << ") [bp " << bp_move.toString() << " (" << stats[bp_move].mean << ") ]" << std::endl << std::flush;
+    HANABI_LOG(INFO, SearchBot) << "Ran " << loop_count << " search iters over " << num_moves << " moves. ( " << server.handsAsString()
+              << " ) , p " << server.whoAmI() << " --> " << best_move.toString() << " (" << stats[best_move].mean << ") [bp " << bp_move.toString() << " (" << stats[bp_move].mean << ") ]";
   }
   return best_move;
 }
@@ -847,21 +901,21 @@ void SearchBot::pleaseMakeMove(Server &server)
 {
     simulserver_.sync(server);
     Move bp_move = simulserver_.simulatePlayerMove(me_, players_[me_].get());
-    std::cerr << now() << "Blueprint strat says to play " << bp_move.toString() << std::endl;
+    HANABI_LOG(INFO, SearchBot) << "Blueprint strat says to play " << bp_move.toString();
 
     SearchStats stats;
-    auto hand_dist_keys = copyKeys(hand_distribution_);
-    applyDelayedObservations(hand_distribution_, hand_dist_keys);
+    const int iters_before = total_iters_;
+    applyDelayedObservations(hand_distribution_, params_);
     HandDistCDF cdf = populateHandDistCDF(hand_distribution_);
     Move move = doSearch_(me_, bp_move, Move(), players_[me_].get(), hand_distribution_, cdf, stats, gen_, server);
-    logSearchResults(stats, server.numPlayers(), me_);
-    if (bp_move != move) std::cerr << now() << "Search changed move. ";
-    std::cerr << now() << "Blueprint picked " << bp_move.toString() << " with average score " << stats[bp_move].mean
-              << "; search picked " << move.toString() << " with average score " << stats[move].mean << std::endl;
+    logSearchResults(stats, server.numPlayers(), me_, params_);
+    HANABI_LOG(INFO, SearchBot) << (bp_move != move ? "Search changed move. " : "")
+              << "Blueprint picked " << bp_move.toString() << " with average score " << stats[bp_move].mean
+              << "; search picked " << move.toString() << " with average score " << stats[move].mean;
     if (move != bp_move) {
       changed_moves_++;
       score_difference_ += stats[move].mean - stats[bp_move].mean;
-      if (DOUBLE_SEARCH) {
+      if (params_.DOUBLE_SEARCH) {
         SearchStats unbiased_stats;
         SearchStats unbiased_win_stats;
         doSearch_(me_, bp_move, Move(), players_[me_].get(), hand_distribution_, cdf, unbiased_stats, gen_, server, false, &unbiased_win_stats);
@@ -869,6 +923,10 @@ void SearchBot::pleaseMakeMove(Server &server)
         unbiased_win_difference_ += unbiased_win_stats[move].mean - unbiased_win_stats[bp_move].mean;
       }
     }
+    last_move_metrics_.beliefRangeSize = hand_distribution_.size();
+    last_move_metrics_.beliefBytes = hand_distribution_.memoryUsage();
+    last_move_metrics_.rollouts = total_iters_ - iters_before;
+    last_move_metrics_.deviated = (move != bp_move);
 
     execute_(me_, move, server);
 }
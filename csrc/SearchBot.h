@@ -16,47 +16,40 @@
 #include <fstream>
 
 
-namespace SearchBotParams {
-  // read in parameters from environment variables
-  const std::string BPBOT = Params::getParameterString("BPBOT", "SmartBot",
-    "The blueprint agent to use for search.");
-  const int SEARCH_PLAYER = Params::getParameterInt("SEARCH_PLAYER", -1,
-    "For single-agent search, which player performs search (negative numbers count from the end).");
-  const int SEARCH_ALL = Params::getParameterInt("SEARCH_ALL", 0,
-    "If 1, all agents perform search independently (unsound)");
-  // hack: not const because we twiddle it in extension.cc
-  extern float SEARCH_THRESH; // score threshold to override the blueprint
-  const int SEARCH_N = Params::getParameterInt("SEARCH_N", 10000,
-    "Number of MC rollouts to perform for search.");
-  const int DOUBLE_SEARCH = Params::getParameterInt("DOUBLE_SEARCH", 0,
-    "Perform a second (independent) search to use as an unbiased estimator of the true scores.");
-  const float PARTNER_UNIFORM_UNC = Params::getParameterFloat("PARTNER_UNIFORM_UNC", 0.,
-    "Add 'uniform' uncertainty to the belief update. Should be 0-1, with 1 corresponding to assuming a uniform policy.");
-  const float PARTNER_BOLTZMANN_UNC = Params::getParameterFloat("PARTNER_BOLTZMANN_UNC", 0.,
-    "Assume the TorchBot partner plays a Boltzmann distribution of actions proportional to exp(Q_a / T), where T is chosen so the 'best' action is played with probability 1-unc. (TorchBot only).");
-
-  const int OPTIMIZE_WINS = Params::getParameterInt("OPTIMIZE_WINS", 0,
-    "Have search ptimize for wins (25 points) rather than max score. This tends to produce worse scores *and* fewer wins, due to bad reward shaping.");
-  const int UCB = Params::getParameterInt("UCB", 1,
-    "Use UCB for search MC rollouts.");
-  const int SEARCH_BASELINE = Params::getParameterInt("SEARCH_BASELINE", 0,
-    "If 1, subtract blueprint action EV from EVs for other actions during MC rollouts; reduces the number of MC rollouts required.");
-  const int DELAYED_OBS_THRESH = Params::getParameterInt("DELAYED_OBS_THRESH", 100000,
-    "Only apply observations to belief bots if the range is below this size. For TorchBot, this trades off time vs space "
-    "(higher THRESH uses less memory at the cost of more compute).");
-} // namespace SearchBotParams
-
-
-void logSearchResults(const SearchStats &stats, int numPlayers, int me);
+/* SearchBot's parameters. Each comes from the environment variable of the
+ * same name, unless the Params::Context in effect when the bot is created
+ * overrides it (see Hanabi::ParamsBotFactory); so bots in different games
+ * of one process can search differently. See SearchBot.cc for what each
+ * of them does. */
+struct SearchBotParams {
+  std::string BPBOT;
+  int SEARCH_PLAYER;
+  int SEARCH_ALL;
+  float SEARCH_THRESH; // score threshold to override the blueprint
+  int SEARCH_N;
+  int DOUBLE_SEARCH;
+  float PARTNER_UNIFORM_UNC;
+  float PARTNER_BOLTZMANN_UNC;
+  int OPTIMIZE_WINS;
+  int UCB;
+  int SEARCH_BASELINE;
+  int DELAYED_OBS_THRESH;
+
+  explicit SearchBotParams(const Params::Context &params = Params::Context::current());
+};
+
+
+void logSearchResults(const SearchStats &stats, int numPlayers, int me, const SearchBotParams &params);
 
 void applyDelayedObservations(
   HandDist &handDist,
-  const std::vector<BoxedHand> &handDistKeys
+  const SearchBotParams &params
 );
 
 struct SearchBot : public Hanabi::Bot {
   /* public API */
   SearchBot(int index, int numPlayers, int handSize);
+  ~SearchBot() override;
   void pleaseObserveBeforeMove(const Hanabi::Server &server) override;
   void pleaseMakeMove(Hanabi::Server &server) override;
     void pleaseObserveBeforeDiscard(const Hanabi::Server &server, int from, int card_index) override;
@@ -64,6 +57,15 @@ struct SearchBot : public Hanabi::Bot {
     void pleaseObserveColorHint(const Hanabi::Server &server, int from, int to, Hanabi::Color color, Hanabi::CardIndices card_indices) override;
     void pleaseObserveValueHint(const Hanabi::Server &server, int from, int to, Hanabi::Value value, Hanabi::CardIndices card_indices) override;
   void pleaseObserveAfterMove(const Hanabi::Server &server) override;
+  Hanabi::MoveMetrics getMoveMetrics() const override { return last_move_metrics_; }
+
+  /* Build the initial hands (see initialHands) and warm up the blueprint. */
+  static void warmUp(int numPlayers, int handSize);
+
+  /* Every hand of handSize cards that a full deck could deal, packed and
+   * sorted in HandDist order. Enumerated once per process and then shared
+   * by every game, which only has to reweight it for the cards it can see. */
+  static const std::vector<PackedHand> &initialHands(int handSize);
 
 protected:
   virtual void init_(const Hanabi::Server &server);
@@ -71,9 +73,9 @@ protected:
   /* == belief update helper == */
   virtual void applyToAll(ObservationFunc f);
 
-  /* Populate hand_distribution_ with all possible hands I may have based on
+  /* Populate handDist with all possible hands I may have based on
    * the deck composition (i.e. initial deck minus partner hands) */
-  virtual void populateInitialHandDistribution_(Hand &hand, float prob, DeckComposition &deck, int handSize, int who, HandDist &handDist, const BotVec &partners);
+  virtual void populateInitialHandDistribution_(const DeckComposition &deck, int handSize, HandDist &handDist, const BotVec &partners);
 
   /* Remove all hands from my hand distribution that are inconsistent with the
    * hint given. */
@@ -104,6 +106,7 @@ protected:
                  const Hanabi::Server &server, bool verbose=true,
                  SearchStats *win_stats=nullptr) const;
 
+  const SearchBotParams params_;
   std::mt19937 gen_;
   SimulServer simulserver_;
   bool inited_ = false;
@@ -125,6 +128,7 @@ protected:
   double unbiased_score_difference_ = 0;
   double unbiased_win_difference_ = 0;
   mutable int total_iters_ = 0;
+  Hanabi::MoveMetrics last_move_metrics_;
 
   std::ofstream dumpFile_;
   int numFrames_ = 0;
@@ -136,18 +140,20 @@ template<>
 struct BotFactory<SearchBot> final : public Hanabi::BotFactory
 {
     Hanabi::Bot *create(int index, int numPlayers, int handSize) const override {
-      int searchPlayer = SearchBotParams::SEARCH_PLAYER;
+      const SearchBotParams params;
+      int searchPlayer = params.SEARCH_PLAYER;
       if (searchPlayer < 0) {
         searchPlayer += numPlayers;
       }
-      if (index == searchPlayer || SearchBotParams::SEARCH_ALL) {
+      if (index == searchPlayer || params.SEARCH_ALL) {
         return new SearchBot(index, numPlayers, handSize);
       } else {
-        auto bpFactory = Hanabi::getBotFactory(SearchBotParams::BPBOT);
+        auto bpFactory = Hanabi::getBotFactory(params.BPBOT);
         Hanabi::Bot *bot = bpFactory->create(index, numPlayers, handSize);
         bot->setPermissive(true);
         return bot;
       }
     }
     void destroy(Hanabi::Bot *bot) const override { delete bot; }
+    void warmUp(int numPlayers, int handSize) const override { SearchBot::warmUp(numPlayers, handSize); }
 };
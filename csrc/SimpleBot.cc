@@ -107,10 +107,23 @@ void SimpleBot::pleaseObserveColorHint(const Hanabi::Server &server, int /*from*
     Pile pile = server.pileOf(color);
     int value = pile.size() + 1;
 
-    assert(1 <= value && value <= 5);
+    assert((1 <= value && value <= 5) || permissive_);
 
     for (int i=0; i < card_indices.size(); ++i) {
         CardKnowledge &knol = handKnowledge_[to][card_indices[i]];
+        if (permissive_) {
+            /* A partner who doesn't share our conventions may contradict
+             * what we thought we knew; if so, trust the hint instead. It
+             * may even name the color of a finished pile. */
+            if (knol.cannotBe(color) || (value <= 5 && knol.cannotBe(Value(value)))) {
+                knol = CardKnowledge();
+            }
+            if (value > 5) {
+                knol.setMustBe(color);
+                knol.isPlayable = false;
+                continue;
+            }
+        }
         knol.setMustBe(color);
         knol.setMustBe(Value(value));
         knol.isPlayable = true;
@@ -137,6 +150,7 @@ void SimpleBot::pleaseObserveValueHint(const Hanabi::Server &server, int from, i
 
     for (int i=0; i < card_indices.size(); ++i) {
         CardKnowledge &knol = handKnowledge_[to][card_indices[i]];
+        if (permissive_ && knol.cannotBe(value)) knol = CardKnowledge();
         knol.setMustBe(value);
         knol.isPlayable = true;
     }
@@ -198,7 +212,7 @@ bool SimpleBot::maybeGiveHelpfulHint(Server &server)
     for (int i = 1; i < numPlayers; ++i) {
         const int partner = (me_ + i) % numPlayers;
         assert(partner != me_);
-        const std::vector<Card> partners_hand = server.handOfPlayer(partner);
+        const HandArray &partners_hand = server.handOfPlayer(partner);
         bool is_really_playable[5];
         for (int c=0; c < partners_hand.size(); ++c) {
             is_really_playable[c] =
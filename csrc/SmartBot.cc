@@ -427,28 +427,20 @@ SmartBot::SmartBot(int index, int numPlayers, int handSize)
 
 bool SmartBot::isPlayable(Card card) const
 {
-    const int playableValue = server_->pileOf(card.color).size() + 1;
-    return (card.value == playableValue);
+    return server_->derivedFacts().isPlayable(card);
 }
 
 bool SmartBot::isValuable(Card card) const
 {
     /* A card which has not yet been played, and which is the
      * last of its kind, is valuable. */
-    if (playedCount_[card.color][card.value] != card.count()-1) return false;
-    return !this->isWorthless(card);
+    return server_->derivedFacts().isCritical(card);
 }
 
 bool SmartBot::isWorthless(Card card) const
 {
-    const int playableValue = server_->pileOf(card.color).size() + 1;
-    if (card.value < playableValue) return true;
     /* If all the red 4s are in the discard pile, then the red 5 is worthless. */
-    while (card.value > playableValue) {
-        --card.value;
-        if (playedCount_[card.color][card.value] == card.count()) return true;
-    }
-    return false;
+    return server_->derivedFacts().isDead(card);
 }
 
 /* Could this card be playable, if it were known to be of value "value"? */
@@ -507,7 +499,7 @@ void SmartBot::updateEyesightCount()
                 }
             }
         } else {
-            const std::vector<Card> hand = server_->handOfPlayer(p);
+            const HandArray &hand = server_->handOfPlayer(p);
             for (int i=0; i < hand.size(); ++i) {
                 const Card &card = hand[i];
                 this->eyesightCount_[card.color][card.value] += 1;
@@ -874,7 +866,7 @@ int reduction_in_entropy(const std::vector<CardKnowledge>& oldKnols, const std::
 template<class F>
 Hint SmartBot::bestHintForPlayerGivenConstraint(int to, F&& is_okay) const
 {
-    std::vector<Card> partners_hand = server_->handOfPlayer(to);
+    const HandArray &partners_hand = server_->handOfPlayer(to);
     bool colors[BLUE+1] = {};
     bool values[5+1] = {};
     for (const Card &card : partners_hand) {
@@ -930,7 +922,7 @@ Hint SmartBot::bestHintForPlayerGivenConstraint(int to, F&& is_okay) const
 Hint SmartBot::bestHintForPlayer(int partner) const
 {
     assert(partner != me_);
-    const std::vector<Card> partners_hand = server_->handOfPlayer(partner);
+    const HandArray &partners_hand = server_->handOfPlayer(partner);
 
     bool is_really_playable[5];
     for (int c=0; c < partners_hand.size(); ++c) {
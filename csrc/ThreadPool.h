@@ -77,7 +77,7 @@ inline ThreadPool::ThreadPool(size_t threads)
         workers.emplace_back(
             [this]
             {
-                boost::fibers::use_scheduling_algorithm< boost::fibers::algo::shared_work >();
+                boost::fibers::use_scheduling_algorithm< boost::fibers::algo::shared_work >(true);
                 this->b->wait();
                 while(true) {
                     std::unique_lock<std::mutex> lock(this->mtx);
@@ -89,7 +89,7 @@ inline ThreadPool::ThreadPool(size_t threads)
             }
         );
     }
-    boost::fibers::use_scheduling_algorithm< boost::fibers::algo::shared_work >();
+    boost::fibers::use_scheduling_algorithm< boost::fibers::algo::shared_work >(true);
     b->wait();
 }
 
@@ -9,6 +9,7 @@
 #include "TorchBot.h"
 #include "SmartBot.h"
 #include "HleUtils.h"
+#include "Log.h"
 
 #include <torch/torch.h>
 #include <torch/csrc/autograd/grad_mode.h>
@@ -17,7 +18,7 @@ using namespace Hanabi;
 using namespace TorchBotParams;
 
 static void _registerBots() {
-  std::cout << "Registering torchbots..." << std::endl;
+  HANABI_LOG(DEBUG, TorchBot) << "Registering torchbots...";
   registerBotFactory("TorchBot", std::shared_ptr<Hanabi::BotFactory>(new ::BotFactory<TorchBot>()));
 }
 
@@ -72,7 +73,7 @@ TensorDict make_init_hx() {
   // return vec_to_tuple(init_hx_vec);
 }
 
-void softmax_(float* model_output, const std::vector<Move> &legal_moves, const Server &server) {
+void softmax_(float* model_output, const MoveList &legal_moves, const Server &server) {
   double sum = 0;
   double max_val = -1e9;
   for (auto move: legal_moves) {
@@ -95,6 +96,14 @@ void softmax_(float* model_output, const std::vector<Move> &legal_moves, const S
   }
 }
 
+void TorchBot::warmUp(int numPlayers, int handSize)
+{
+    if (TORCHBOT_MODEL != "") {
+      get_torchbot_async_module(TORCHBOT_MODEL);
+    }
+    make_init_hx();
+}
+
 // NOTE(hengyuan): somehow static does not work
 // static TensorDict init_hx = make_init_hx();
 
@@ -123,7 +132,7 @@ static std::uniform_real_distribution<double> real_dist(0., 1.);
 
 void TorchBot::updateActionProbs(
   at::Tensor model_output,
-  const std::vector<Move> &legal_moves,
+  const MoveList &legal_moves,
   int num_moves,
   const Server &server
 ) {
@@ -208,7 +217,7 @@ void TorchBot::pleaseObserveBeforeMove(const Server &server)
     assert(model_output.size(-1) == num_moves);
 
     auto out_data = model_output.data<float>();
-    std::vector<Move> legal_moves = enumerateLegalMoves(server);
+    MoveList legal_moves = enumerateLegalMoves(server);
 
     float best_pred = -1e9;
     for (auto move : legal_moves) {
@@ -316,7 +325,7 @@ torch::Tensor TorchBot::applyModel(const HleSerializedMove &frame) {
   auto feat_data = feats.data<float>();
   for (size_t i = 0; i < frame_vec.size(); i++) {
     if (frame_vec[i] != frame_vec[i]) { // NaN
-      std::cerr << "input data " << i << " = " << frame_vec[i] << std::endl;
+      HANABI_LOG(ERROR, TorchBot) << "input data " << i << " = " << frame_vec[i];
       throw std::runtime_error("Inputs are NaN");
     }
     feat_data[i] = frame_vec[i];
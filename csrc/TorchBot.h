@@ -62,7 +62,7 @@ class TorchBot final : public Hanabi::Bot {
 
     void updateActionProbs(
       at::Tensor model_output,
-      const std::vector<Move> &legal_moves,
+      const MoveList &legal_moves,
       int num_moves,
       const Hanabi::Server &server
     );
@@ -79,4 +79,6 @@ class TorchBot final : public Hanabi::Bot {
     const std::map<int, float> &getActionProbs() const override;
     void setActionUncertainty(float boltzmann_unc) override;
     TorchBot *clone() const override;
+    /* Loads TORCHBOT_MODEL. */
+    static void warmUp(int numPlayers, int handSize);
 };
@@ -7,8 +7,12 @@
 #include <tuple>
 #include <torch/extension.h>
 #include <ctime>
+#include <thread>
 
 #include "BotFactory.h"
+#include "Eval.h"
+#include "GameRecord.h"
+#include "Log.h"
 #include "PyBot.h"
 #include "SearchBot.h"
 
@@ -51,7 +55,7 @@ void end_game(Server &server, PyBot *bot, std::thread &t) {
     server.endGameByBombingOut();
     bot->wait();
   }
-  getThreadPool().close();
+  // leave the thread pool (and any model on it) running for the next game
   // t.join();
 }
 
@@ -60,12 +64,12 @@ std::string get_botname() {
 }
 
 float get_search_thresh() {
-  return SearchBotParams::SEARCH_THRESH;
+  return SearchBotParams().SEARCH_THRESH;
 }
 
 void set_search_thresh(float thresh) {
-  std::cerr << "Set SEARCH_THRESH to " << thresh << std::endl;
-  SearchBotParams::SEARCH_THRESH = thresh;
+  HANABI_LOG(INFO, Params) << "Set SEARCH_THRESH to " << thresh;
+  Params::setParameter("SEARCH_THRESH", std::to_string(thresh));
 }
 
 
@@ -101,85 +105,6 @@ std::vector<CardKnowledge> pybot_get_card_knowledge(const PyBot &pybot) {
 }
 
 
-////////////////////////////////////////////////////////////////////////////////
-// Test harness code
-////////////////////////////////////////////////////////////////////////////////
-
-struct Statistics {
-    int games;
-    int totalScore;
-    int scoreDistribution[26];
-    int mulligansUsed[4];
-};
-
-static void dump_stats(std::string botname, Statistics stats)
-{
-    const double dgames = stats.games;
-    const int perfectGames = stats.scoreDistribution[25];
-
-    std::cout << "Over " << stats.games << " games, " << botname << " scored an average of "
-              << (stats.totalScore / dgames) << " points per game.\n";
-    if (perfectGames != 0) {
-        const double winRate = 100*(perfectGames / dgames);
-        std::cout << "  " << winRate << " percent were perfect games.\n";
-    }
-    if (stats.mulligansUsed[0] != stats.games) {
-        std::cout << "  Mulligans used: 0 (" << 100*(stats.mulligansUsed[0] / dgames)
-                  << "%); 1 (" << 100*(stats.mulligansUsed[1] / dgames)
-                  << "%); 2 (" << 100*(stats.mulligansUsed[2] / dgames)
-                  << "%); 3 (" << 100*(stats.mulligansUsed[3] / dgames) << "%).\n";
-    }
-}
-
-void eval_bot(
-  std::string botname,
-  int players,
-  int games,
-  int log_every,
-  int seed
-) {
-    // special case slurm runs
-    if (seed < 0 && std::getenv("SLURM_PROCID")) {
-      // CAREFUL! make sure this doesn't wrap around and become negative
-      seed = (std::stol(std::getenv("SLURM_JOBID")) + std::stol(std::getenv("SLURM_PROCID")) * 102797) % 1000000000;
-      printf("Set seed from slurm to %d\n", seed);
-    }
-    if (seed <= 0) {
-        std::srand(std::time(NULL));
-        seed = std::rand();
-    }
-    printf("--seed %d\n", seed);
-
-    Statistics stats = {};
-
-    Hanabi::Server server;
-    server.setLog(&std::cerr);
-    auto botFactory = getBotFactory(botname);
-
-    server.srand(seed);
-
-    for (int i=0; i < games; ++i) {
-        int score = server.runGame(*botFactory, players);
-        std::cout << "Final score " << i << " : " << score << " bomb: "
-                  << (server.mulligansRemaining() == 0 ? 1 : 0) << std::endl;
-        assert(score == server.currentScore());
-        assert(0 <= server.mulligansUsed() && server.mulligansUsed() <= 3);
-        stats.games++;
-        stats.totalScore += score;
-        stats.scoreDistribution[score] += 1;
-        stats.mulligansUsed[server.mulligansUsed()] += 1;
-
-        if (i % log_every == 0) {
-          dump_stats(botname, stats);
-        }
-    }
-    dump_stats(botname, stats);
-
-    Hanabi::getThreadPool().close();
-}
-
-
-
 PYBIND11_MODULE(TORCH_EXTENSION_NAME, m) {
 
   // test harness code
@@ -189,7 +114,49 @@ PYBIND11_MODULE(TORCH_EXTENSION_NAME, m) {
       py::arg("players")=2,
       py::arg("games")=1000,
       py::arg("log_every")=100,
-      py::arg("seed")=-1
+      py::arg("seed")=-1,
+      py::arg("jobs")=0,
+      py::arg("record")="",
+      py::arg("metrics")=""
+  );
+  m.def("eval_games", &eval_games,
+      py::arg("botname"),
+      py::arg("players"),
+      py::arg("seed"),
+      py::arg("games"),
+      py::arg("results"),
+      py::arg("jobs")=1
+  );
+  m.def("eval_tournament", &eval_tournament,
+      py::arg("botnames"),
+      py::arg("players")=2,
+      py::arg("games")=1000,
+      py::arg("seed")=-1,
+      py::arg("jobs")=1,
+      py::arg("matrix")=""
+  );
+  m.def("eval_sweep", &eval_sweep,
+      py::arg("botname"),
+      py::arg("configs"),
+      py::arg("players")=2,
+      py::arg("games")=1000,
+      py::arg("seed")=-1,
+      py::arg("jobs")=1
+  );
+  m.def("eval_paired", &eval_paired,
+      py::arg("bot_a"),
+      py::arg("bot_b"),
+      py::arg("players")=2,
+      py::arg("games")=1000,
+      py::arg("log_every")=100,
+      py::arg("seed")=-1,
+      py::arg("jobs")=0
+  );
+  m.def("benchmark_rollouts", &benchmarkRollouts,
+      py::arg("botname"),
+      py::arg("players")=2,
+      py::arg("rollouts")=10000,
+      py::arg("lean")=true
   );
 
   // GUI interface code
@@ -200,13 +167,19 @@ PYBIND11_MODULE(TORCH_EXTENSION_NAME, m) {
   m.def("get_botname", &get_botname);
   m.def("get_search_thresh", &get_search_thresh);
   m.def("set_search_thresh", &set_search_thresh);
+  m.def("warm_up", &Hanabi::warmUp,
+      py::arg("botname"),
+      py::arg("players")=2
+  );
+  m.def("set_log_level", &Log::configure, py::arg("spec"));  // e.g. "info,SearchBot=debug"; see Log.h
+  m.def("flush_log", &Log::flush);
 
 
   py::class_<Server, std::shared_ptr<Server>>(m, "HanabiServer")
     .def("whoAmI", &Server::whoAmI)
     .def("activeCard", &Server::activeCard)
     .def("piles", &server_piles)
-    .def("discards", &Server::discards)
+    .def("discards", [](const Server &server) { return std::vector<Card>(server.discards()); })
     .def("hintStonesRemaining", &Server::hintStonesRemaining)
     .def("mulligansRemaining", &Server::mulligansRemaining)
     .def("cardsRemainingInDeck", &Server::cardsRemainingInDeck)
@@ -215,13 +188,51 @@ PYBIND11_MODULE(TORCH_EXTENSION_NAME, m) {
     .def("currentScore", &Server::currentScore)
     .def("handSize", &Server::handSize)
     .def("sizeOfHandOfPlayer", &Server::sizeOfHandOfPlayer)
-    .def("handOfPlayer", &Server::cheatGetHand)
+    .def("handOfPlayer", [](const Server &server, int index) { return std::vector<Card>(server.cheatGetHand(index)); })
     .def("cardIdsOfHandOfPlayer", &Server::cardIdsOfHandOfPlayer)
-    .def("getCurrentDeckComposition", &getCurrentDeckComposition)
+    .def("getCurrentDeckComposition", [](const Server &server, int who) {
+      DeckComposition deck = getCurrentDeckComposition(server, who);
+      std::map<Card, int> result;
+      for (int i = 0; i < DeckComposition::NUMCARDS; i++) result[indexToCard(i)] = deck.counts[i];
+      return result;
+    })
     .def("activePlayer", &Server::activePlayer)
     .def_readonly("seed", &Server::seed_)
   ;
 
+  // game records and replays
+  m.def("read_game_records", &readGameRecords);
+
+  py::class_<RecordedMove>(m, "RecordedMove")
+    .def_readonly("type", &RecordedMove::type)
+    .def_readonly("to", &RecordedMove::to)
+    .def_readonly("value", &RecordedMove::value)
+    .def("__repr__", &RecordedMove::toString)
+  ;
+
+  py::class_<GameRecord>(m, "GameRecord")
+    .def_readonly("seed", &GameRecord::seed)
+    .def_readonly("numPlayers", &GameRecord::numPlayers)
+    .def_readonly("handSize", &GameRecord::handSize)
+    .def_readonly("deck", &GameRecord::deck)
+    .def_readonly("moves", &GameRecord::moves)
+    .def_readonly("score", &GameRecord::score)
+    .def_readonly("mulligansUsed", &GameRecord::mulligansUsed)
+  ;
+
+  py::class_<GameReplay, Server, std::shared_ptr<GameReplay>>(m, "GameReplay")
+    .def(py::init<const GameRecord &>())
+    .def("numMoves", &GameReplay::numMoves)
+    .def("turn", &GameReplay::turn)
+    .def("nextMove", &GameReplay::nextMove)
+    .def("step", &GameReplay::step)
+    .def("seek", &GameReplay::seek)
+    .def("setObservingPlayer", &GameReplay::setObservingPlayer)
+    .def("setObserver", [](GameReplay &replay, int seat, const std::string &botname) {
+      replay.setObserver(seat, botname.empty() ? nullptr : getBotFactory(botname));
+    }, py::arg("seat"), py::arg("botname"))  // "" for no observer
+  ;
+
   py::class_<Card>(m, "Card")
     .def_readwrite("color", &Card::color)
     .def_readwrite("value", &Card::value)
@@ -0,0 +1,129 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+
+/* The native `hanabi` executable: eval_bot.py without Python or torch.
+ * It takes the same arguments, e.g.
+ *   hanabi SmartBot --players 3 --games 1000 --jobs 8
+ *   BPBOT=SmartBot hanabi SearchBot --games 10 --metrics searchbot.jsonl
+ *   hanabi SmartBot --against HolmesBot --games 1000 --jobs 8
+ *   hanabi SmartBot --tournament HolmesBot,SimpleBot --games 100 --jobs 8
+ *   BPBOT=SmartBot hanabi SearchBot --sweep "SEARCH_N=1000;SEARCH_N=10000,UCB=0" --games 10
+ * Bot parameters come from environment variables, unless --sweep overrides them. */
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Eval.h"
+
+static const char usage[] =
+    "usage: hanabi botname [--players N] [--games N] [--log_every N] [--seed N] [--jobs N]\n"
+    "                      [--record PATH] [--metrics PATH]\n"
+    "                      [--against BOT] [--tournament BOT,BOT,... [--matrix PATH]]\n"
+    "                      [--sweep NAME=VALUE,...;NAME=VALUE,...;...]\n"
+    "\n"
+    "  --seed       -1 means to pick a random seed\n"
+    "  --jobs       0 plays the games one after another on a single server; N > 0\n"
+    "               plays them on N threads, with results that do not depend on N\n"
+    "  --record     write a binary record of every game to this (gzipped) file\n"
+    "  --metrics    write per-game and per-move metrics to this file as JSON lines\n"
+    "  --against    play another bot on the same decks, reporting paired differences\n"
+    "  --tournament play every seating of botname and these bots on the same decks,\n"
+    "               reporting the cross-play score matrix (also to --matrix PATH)\n"
+    "  --sweep      play botname on the same decks under each of these ';'-separated\n"
+    "               sets of parameters, which override the environment\n";
+
+static std::vector<std::string> split(const std::string &list, char sep)
+{
+    std::vector<std::string> items;
+    std::istringstream in(list);
+    std::string item;
+    while (std::getline(in, item, sep)) items.push_back(item);
+    return items;
+}
+
+int main(int argc, char **argv)
+{
+    std::string botname;
+    int players = 2;
+    int games = 1000;
+    int log_every = 100;
+    int seed = -1;
+    int jobs = 0;
+    std::string record, metrics, against, tournament, matrix, sweep;
+
+    for (int i=1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            std::cout << usage;
+            return 0;
+        }
+        if (arg.compare(0, 2, "--") != 0) {
+            if (!botname.empty()) {
+                std::cerr << usage;
+                return 2;
+            }
+            botname = arg;
+            continue;
+        }
+        if (i+1 == argc) {
+            std::cerr << "hanabi: " << arg << " needs a value\n" << usage;
+            return 2;
+        }
+        const char *value = argv[++i];
+        if (arg == "--players") players = std::atoi(value);
+        else if (arg == "--games") games = std::atoi(value);
+        else if (arg == "--log_every") log_every = std::atoi(value);
+        else if (arg == "--seed") seed = std::atoi(value);
+        else if (arg == "--jobs") jobs = std::atoi(value);
+        else if (arg == "--record") record = value;
+        else if (arg == "--metrics") metrics = value;
+        else if (arg == "--against") against = value;
+        else if (arg == "--tournament") tournament = value;
+        else if (arg == "--matrix") matrix = value;
+        else if (arg == "--sweep") sweep = value;
+        else {
+            std::cerr << "hanabi: unknown option " << arg << "\n" << usage;
+            return 2;
+        }
+    }
+    if (botname.empty()) {
+        std::cerr << usage;
+        return 2;
+    }
+
+    try {
+        if (!sweep.empty()) {
+            std::vector<std::map<std::string, std::string>> configs;
+            for (const std::string &config : split(sweep, ';')) {
+                configs.emplace_back();
+                for (const std::string &setting : split(config, ',')) {
+                    const size_t eq = setting.find('=');
+                    if (eq == std::string::npos) throw std::runtime_error("expected NAME=VALUE, not " + setting);
+                    configs.back()[setting.substr(0, eq)] = setting.substr(eq + 1);
+                }
+            }
+            eval_sweep(botname, configs, players, games, seed, std::max(jobs, 1));
+        } else if (!tournament.empty()) {
+            std::vector<std::string> botnames = split(tournament, ',');
+            botnames.insert(botnames.begin(), botname);
+            eval_tournament(botnames, players, games, seed, std::max(jobs, 1), matrix);
+        } else if (!against.empty()) {
+            eval_paired(botname, against, players, games, log_every, seed, jobs);
+        } else {
+            eval_bot(botname, players, games, log_every, seed, jobs, record, metrics);
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "hanabi: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
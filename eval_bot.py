@@ -29,12 +29,69 @@ if __name__ == "__main__":
     parser.add_argument('--log_every', type=int, default=100)
     parser.add_argument('--seed', type=int, default=-1,
                         help="-1 means to pick a random seed")
+    parser.add_argument('--jobs', type=int, default=0,
+                        help="0 plays the games one after another on a single server; "
+                             "N > 0 plays them on N threads, seeding each game from "
+                             "the seed and its index so the results do not depend on N")
+    parser.add_argument('--record', default="",
+                        help="write a binary record of every game to this (gzipped) file")
+    parser.add_argument('--metrics', default="",
+                        help="write per-game and per-move metrics (score, bombs, turns, "
+                             "decision latency, search statistics) to this file as JSON lines")
+    parser.add_argument('--against', default=None,
+                        help="another bot to play on the same decks as botname, "
+                             "reporting the paired differences in score")
+    parser.add_argument('--tournament', default=None,
+                        help="a comma-separated list of other bots; play every assignment "
+                             "of these and botname to the seats, on the same decks, and "
+                             "report the cross-play score matrix")
+    parser.add_argument('--matrix', default="",
+                        help="with --tournament, also write the score matrix to this CSV file")
+    parser.add_argument('--sweep', default=None,
+                        help="';'-separated sets of NAME=VALUE,... parameters (e.g. "
+                             "'SEARCH_N=1000;SEARCH_N=10000,UCB=0'); play botname under each, "
+                             "on the same decks and in this one process")
 
     opt = parser.parse_args()
+    if opt.sweep is not None:
+        hanabi_lib.eval_sweep(
+            opt.botname,
+            [dict(setting.split('=', 1) for setting in config.split(',') if setting)
+             for config in opt.sweep.split(';')],
+            players=opt.players,
+            games=opt.games,
+            seed=opt.seed,
+            jobs=max(opt.jobs, 1)
+        )
+        exit(0)
+    if opt.tournament is not None:
+        hanabi_lib.eval_tournament(
+            [opt.botname] + opt.tournament.split(','),
+            players=opt.players,
+            games=opt.games,
+            seed=opt.seed,
+            jobs=max(opt.jobs, 1),
+            matrix=opt.matrix
+        )
+        exit(0)
+    if opt.against is not None:
+        hanabi_lib.eval_paired(
+            opt.botname,
+            opt.against,
+            players=opt.players,
+            games=opt.games,
+            log_every=opt.log_every,
+            seed=opt.seed,
+            jobs=opt.jobs
+        )
+        exit(0)
     hanabi_lib.eval_bot(
         opt.botname,
         players=opt.players,
         games=opt.games,
         log_every=opt.log_every,
-        seed=opt.seed
+        seed=opt.seed,
+        jobs=opt.jobs,
+        record=opt.record,
+        metrics=opt.metrics
     )
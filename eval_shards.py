@@ -0,0 +1,178 @@
+#!/usr/bin/env python3
+
+# Copyright (c) Facebook, Inc. and its affiliates.
+# All rights reserved.
+#
+# This source code is licensed under the license found in the
+# LICENSE file in the root directory of this source tree.
+
+import argparse
+import json
+import math
+import os
+import random
+import subprocess
+import sys
+
+"""
+Runs an evaluation as a number of shards, each in its own worker process.
+Every game is written to its shard's results file as soon as it finishes,
+so if a run crashes (or is killed), running the same command again picks
+up where it left off without replaying any finished game. When all the
+shards are done, their results are merged into one report.
+
+The games are seeded exactly as eval_bot.py --jobs seeds them, so a sharded
+run scores the same as `eval_bot.py --jobs N --seed S` with the same seed.
+
+    python eval_shards.py SearchBot --games 1000 --shards 8 --dir searchbot_run
+    python eval_shards.py --dir searchbot_run          # resume, or just re-merge
+
+Parameters passed through environment variables (e.g. BPBOT) are not
+recorded, so resume with the same environment.
+"""
+
+MANIFEST = "manifest.json"
+
+
+def shard_path(run_dir, shard):
+    return os.path.join(run_dir, "shard%d.jsonl" % shard)
+
+
+def read_results(path):
+    """
+    Returns {game index: game line} for every finished game in a results file.
+    A line cut short by a crash is dropped; its game will be played again.
+    """
+    results = {}
+    if not os.path.exists(path):
+        return results
+    good_bytes = 0
+    with open(path, 'r') as f:
+        for line in f:
+            try:
+                entry = json.loads(line)
+            except ValueError:
+                break
+            if not line.endswith('\n'):
+                break
+            good_bytes += len(line.encode())
+            if entry['type'] == 'game':
+                results[entry['game']] = entry
+    if good_bytes != os.path.getsize(path):
+        with open(path, 'r+') as f:
+            f.truncate(good_bytes)
+    return results
+
+
+def load_manifest(opt):
+    path = os.path.join(opt.dir, MANIFEST)
+    if os.path.exists(path):
+        manifest = json.load(open(path, 'r'))
+        for key in ('botname', 'players', 'games', 'seed', 'shards'):
+            given = getattr(opt, key)
+            if given is not None and given != manifest[key]:
+                sys.exit("%s was run with %s=%s, not %s" % (opt.dir, key, manifest[key], given))
+        return manifest
+    if opt.botname is None:
+        sys.exit("no run in %s to resume; give a botname to start one" % opt.dir)
+    manifest = {
+        'botname': opt.botname,
+        'players': opt.players or 2,
+        'games': opt.games or 1000,
+        'seed': opt.seed if opt.seed is not None and opt.seed > 0 else random.randint(1, 1000000000),
+        'shards': opt.shards or 4,
+    }
+    os.makedirs(opt.dir, exist_ok=True)
+    with open(path, 'w') as f:
+        json.dump(manifest, f, indent=2)
+    return manifest
+
+
+def run_shard(manifest, run_dir, shard, jobs):
+    import torch  # make sure to dynamically load everything before loading hanabi_lib
+    import hanabi_lib
+    path = shard_path(run_dir, shard)
+    done = read_results(path)
+    games = [i for i in range(shard, manifest['games'], manifest['shards']) if i not in done]
+    print("Shard %d: %d games done, %d to play" % (shard, len(done), len(games)), flush=True)
+    if games:
+        hanabi_lib.eval_games(
+            manifest['botname'],
+            players=manifest['players'],
+            seed=manifest['seed'],
+            games=games,
+            results=path,
+            jobs=jobs
+        )
+
+
+def merge(manifest, run_dir):
+    results = {}
+    for shard in range(manifest['shards']):
+        results.update(read_results(shard_path(run_dir, shard)))
+    games = [results[i] for i in sorted(results)]
+    with open(os.path.join(run_dir, "results.jsonl"), 'w') as f:
+        for entry in games:
+            f.write(json.dumps(entry) + '\n')
+
+    N = len(games)
+    print("Finished %d of %d games (--seed %d)" % (N, manifest['games'], manifest['seed']))
+    if N == 0:
+        return
+    scores = [entry['score'] for entry in games]
+    mean = sum(scores) / N
+    sd = math.sqrt(sum((s - mean) ** 2 for s in scores) / (N - 1)) if N > 1 else 0
+    win_frac = sum(1 for s in scores if s == 25) / N
+    bombs = sum(entry['bomb'] for entry in games)
+    print("Over %d games, %s scored an average of %g +/- %g points per game." % (N, manifest['botname'], mean, sd / math.sqrt(N)))
+    print("  %g percent were perfect games." % (100 * win_frac))
+    print("  Mulligans used: " + "; ".join(
+        "%d (%g%%)" % (m, 100 * sum(1 for e in games if e['mulligans'] == m) / N) for m in range(4)) + ".")
+    print("  Bombed out: %g%% (%d / %d)" % (100 * bombs / N, bombs, N))
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description='Resumable, sharded evaluation of a bot')
+    parser.add_argument('botname', nargs='?', default=None,
+                        help="the bot to evaluate; may be left out when resuming")
+    parser.add_argument('--dir', required=True,
+                        help="directory holding the run's manifest and per-shard results")
+    parser.add_argument('--players', type=int, default=None)
+    parser.add_argument('--games', type=int, default=None)
+    parser.add_argument('--seed', type=int, default=None,
+                        help="-1 or unset means to pick a random seed")
+    parser.add_argument('--shards', type=int, default=None,
+                        help="number of worker processes (default 4)")
+    parser.add_argument('--jobs', type=int, default=1,
+                        help="threads per worker process")
+    parser.add_argument('--shard', type=int, default=None,
+                        help=argparse.SUPPRESS)  # run a single shard, in this process
+    parser.add_argument('--merge_only', action='store_true',
+                        help="don't play any games; just merge the results so far")
+
+    opt = parser.parse_args()
+    if opt.seed is not None and opt.seed <= 0:
+        opt.seed = None
+    manifest = load_manifest(opt)
+
+    if opt.shard is not None:
+        run_shard(manifest, opt.dir, opt.shard, opt.jobs)
+        exit(0)
+
+    failed = []
+    if not opt.merge_only:
+        workers = []
+        for shard in range(manifest['shards']):
+            log = open(os.path.join(opt.dir, "shard%d.log" % shard), 'a')
+            cmd = [sys.executable, os.path.abspath(__file__), '--dir', opt.dir,
+                   '--shard', str(shard), '--jobs', str(opt.jobs)]
+            workers.append((shard, subprocess.Popen(cmd, stdout=log, stderr=subprocess.STDOUT)))
+        for shard, worker in workers:
+            if worker.wait() != 0:
+                failed.append(shard)
+
+    merge(manifest, opt.dir)
+    if failed:
+        print("Shards %s failed (see their logs); run this again to resume them." %
+              ", ".join(map(str, failed)))
+        exit(1)
@@ -30,9 +30,14 @@ setup(
             "csrc/SearchBot.cc",
             "csrc/JointSearchBot.cc",
             "csrc/HanabiServer.cc",
+            "csrc/Log.cc",
+            "csrc/GameRecord.cc",
+            "csrc/Metrics.cc",
+            "csrc/Eval.cc",
             "csrc/BotUtils.cc",
+            "csrc/BeliefKernels.cc",
         ] + OPTIONAL_SRC,
-        extra_compile_args=['-fPIC', '-std=c++1y', '-Wno-deprecated', '-O3', '-Wno-sign-compare', '-D_GLIBCXX_USE_CXX11_ABI=0', '-DCARD_ID=1'],
+        extra_compile_args=['-fPIC', '-std=c++1y', '-Wno-deprecated', '-O3', '-Wno-sign-compare', '-D_GLIBCXX_USE_CXX11_ABI=0'],
         libraries = ['z'] + boost_libs,
         library_dirs=['/usr/local/lib'],
         include_dirs=['csrc'],
@@ -0,0 +1,24 @@
+#  Copyright (c) Facebook, Inc. and its affiliates.
+#  All rights reserved.
+#
+#  This source code is licensed under the license found in the
+#  LICENSE file in the root directory of this source tree.
+
+import torch  # make sure to dynamically load everything beforee loading hanabi_lib
+import sys
+# torch.ops.load_library("hanabi_lib.so")
+from hanabi_lib import *
+
+def run(botname="SmartBot", rollouts=10000):
+    for players in (2, 3, 4, 5):
+        simul_rate, simul_score = benchmark_rollouts(botname, players, rollouts, lean=False)
+        lean_rate, lean_score = benchmark_rollouts(botname, players, rollouts, lean=True)
+        print(f"{botname} x{players}: SimulServer {simul_rate:.0f} rollouts/sec, "
+              f"RolloutServer {lean_rate:.0f} rollouts/sec "
+              f"({lean_rate / simul_rate:.2f}x)")
+        # same deals, same bots: the lean server must play out identically
+        assert lean_score == simul_score, (lean_score, simul_score)
+
+
+if __name__ == "__main__":
+    run(*sys.argv[1:2])
@@ -0,0 +1,144 @@
+// Copyright (c) Facebook, Inc. and its affiliates.
+// All rights reserved.
+//
+// This source code is licensed under the license found in the
+// LICENSE file in the root directory of this source tree.
+
+// Checks the belief kernels, both the version picked for this CPU and
+// the portable one, against plain loops over unpacked hands, on random
+// hands and at lengths that leave a tail after the last full SIMD step.
+
+#include "BeliefKernels.h"
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace Hanabi;
+
+static int failures = 0;
+
+static void check(bool ok, const char *what, int trial, size_t i) {
+  if (!ok && failures++ < 10) {
+    std::printf("FAIL %s: trial %d, hand %zu\n", what, trial, i);
+  }
+}
+
+static Hand randomHand(std::mt19937 &gen, int size) {
+  Hand hand;
+  for (int i = 0; i < size; i++) {
+    hand.push_back(indexToCard(gen() % 25));
+  }
+  return hand;
+}
+
+// the positions of hand that a hint of this color or value would touch,
+// as Server::cardsMatchingHint finds them
+static unsigned cardsMatchingHint(const Hand &hand, bool color, int value) {
+  unsigned matching = 0;
+  for (int i = 0; i < hand.size(); i++) {
+    if ((color ? (int) hand[i].color : (int) hand[i].value) == value) matching |= 1u << i;
+  }
+  return matching;
+}
+
+static bool hintConsistent(const Hand &hand, bool color, int value, unsigned touched, unsigned relevant) {
+  const unsigned matching = cardsMatchingHint(hand, color, value);
+  for (int i = 0; i < hand.size(); i++) {
+    if ((relevant & (1u << i)) && ((matching ^ touched) & (1u << i))) return false;
+  }
+  return true;
+}
+
+static void testHintConsistentHands(std::mt19937 &gen, int trial, size_t n) {
+  const int size = 1 + gen() % 5;
+  const bool color = gen() % 2;
+  const int value = color ? gen() % 5 : 1 + gen() % 5;
+  std::vector<Hand> hands;
+  std::vector<PackedHand> packed;
+  for (size_t i = 0; i < n; i++) {
+    hands.push_back(randomHand(gen, size));
+    packed.push_back(packHand(hands.back()));
+  }
+  // usually the touched cards of one of the hands, so that some match
+  const unsigned touched = (n > 0 && gen() % 4) ? cardsMatchingHint(hands[gen() % n], color, value) : gen() % 32;
+  const unsigned relevant = gen() % 2 ? ~0u : gen() % 32;
+  std::vector<uint8_t> keep(n, 2), portable(n, 2);
+  hintConsistentHands(packed.data(), n, color, value, touched, relevant, keep.data());
+  hintConsistentHandsPortable(packed.data(), n, color, value, touched, relevant, portable.data());
+  for (size_t i = 0; i < n; i++) {
+    const bool expected = hintConsistent(hands[i], color, value, touched, relevant);
+    check(keep[i] == expected, "hintConsistentHands", trial, i);
+    check(portable[i] == expected, "hintConsistentHandsPortable", trial, i);
+  }
+}
+
+// SearchBot's update before the kernel: prob is scaled by
+// (remaining - k) / remaining, where k is the number of copies of card in
+// the relevant positions; false if that leaves the hand impossible
+static bool reweight(const Hand &hand, Card card, int remaining, unsigned relevant, float &prob) {
+  int in_hand = 0;
+  for (int i = 0; i < hand.size(); i++) {
+    if ((relevant & (1u << i)) && hand[i] == card) in_hand++;
+  }
+  if (in_hand > 0) {
+    float new_prob = prob * (remaining - in_hand) / remaining;
+    if (new_prob <= 0) return false;
+    prob = new_prob;
+  }
+  return true;
+}
+
+static void testReweightHandsForRevealedCard(std::mt19937 &gen, int trial, size_t n) {
+  const int size = 1 + gen() % 5;
+  const Card card = indexToCard(gen() % 25);
+  const int remaining = 1 + gen() % 3;
+  const unsigned relevant = gen() % 2 ? ~0u : gen() % 32;
+  std::vector<Hand> hands;
+  std::vector<PackedHand> packed;
+  std::vector<float> probs;
+  for (size_t i = 0; i < n; i++) {
+    // with plenty of copies of card, to reach k == remaining
+    Hand hand = randomHand(gen, size);
+    for (int j = 0; j < size; j++) {
+      if (gen() % 3 == 0) hand[j] = card;
+    }
+    hands.push_back(hand);
+    packed.push_back(packHand(hand));
+    probs.push_back((gen() % 1000) / 997.0f);
+  }
+  std::vector<float> kernel_probs = probs, portable_probs = probs;
+  std::vector<uint8_t> keep(n, 2), portable(n, 2);
+  reweightHandsForRevealedCard(packed.data(), n, card, remaining, relevant, kernel_probs.data(), keep.data());
+  reweightHandsForRevealedCardPortable(packed.data(), n, card, remaining, relevant, portable_probs.data(),
+                                       portable.data());
+  for (size_t i = 0; i < n; i++) {
+    float prob = probs[i];
+    const bool expected = reweight(hands[i], card, remaining, relevant, prob);
+    check(keep[i] == expected, "reweightHandsForRevealedCard", trial, i);
+    check(portable[i] == expected, "reweightHandsForRevealedCardPortable", trial, i);
+    // the same float operations, so exactly the same probabilities
+    if (expected) {
+      check(kernel_probs[i] == prob, "reweightHandsForRevealedCard prob", trial, i);
+      check(portable_probs[i] == prob, "reweightHandsForRevealedCardPortable prob", trial, i);
+    }
+  }
+}
+
+int main() {
+  std::mt19937 gen(1);
+  const size_t lengths[] = {0, 1, 2, 3, 4, 5, 7, 8, 9, 63, 64, 65, 1001};
+  int trial = 0;
+  for (int repeat = 0; repeat < 50; repeat++) {
+    for (size_t n : lengths) {
+      testHintConsistentHands(gen, trial++, n);
+      testReweightHandsForRevealedCard(gen, trial++, n);
+    }
+  }
+  if (failures > 0) {
+    std::printf("%d failures\n", failures);
+    return 1;
+  }
+  std::printf("belief kernels: %d trials passed\n", trial);
+  return 0;
+}
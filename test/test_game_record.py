@@ -0,0 +1,62 @@
+#  Copyright (c) Facebook, Inc. and its affiliates.
+#  All rights reserved.
+#
+#  This source code is licensed under the license found in the
+#  LICENSE file in the root directory of this source tree.
+
+import torch  # make sure to dynamically load everything beforee loading hanabi_lib
+import json
+import os
+import tempfile
+# torch.ops.load_library("hanabi_lib.so")
+from hanabi_lib import *
+
+# Records games with eval_bot, reads them back, and replays them: the
+# replayed scores must match both the records and a fresh evaluation of
+# the same games.
+
+BOT = "SmartBot"
+PLAYERS = 3
+GAMES = 10
+SEED = 7
+
+def run():
+    with tempfile.TemporaryDirectory() as tmp:
+        record_path = os.path.join(tmp, "games.hrec.gz")
+        results_path = os.path.join(tmp, "results.jsonl")
+        eval_bot(BOT, players=PLAYERS, games=GAMES, log_every=GAMES, seed=SEED, jobs=1, record=record_path)
+        eval_games(BOT, PLAYERS, SEED, list(range(GAMES)), results_path, jobs=1)
+
+        records = read_game_records(record_path)
+        assert len(records) == GAMES, f"read {len(records)} records, expected {GAMES}"
+        with open(results_path) as f:
+            scores = {r["game"]: r["score"] for r in map(json.loads, f) if r["type"] == "game"}
+
+        for i, record in enumerate(records):
+            assert record.numPlayers == PLAYERS
+            assert record.score == scores[i], f"game {i}: recorded {record.score}, evaluated {scores[i]}"
+
+            replay = GameReplay(record)
+            replay.seek(replay.numMoves())
+            assert replay.gameOver()
+            assert replay.currentScore() == record.score, \
+                f"game {i}: replayed {replay.currentScore()}, recorded {record.score}"
+
+            # back and forth, with and without an observer in a seat
+            half = replay.numMoves() // 2
+            replay.seek(half)
+            assert replay.turn() == half and not replay.gameOver()
+            replay.setObserver(1, BOT)
+            replay.seek(replay.numMoves())
+            replay.seek(1)
+            replay.seek(replay.numMoves())
+            assert replay.currentScore() == record.score
+            replay.setObserver(1, "")
+            replay.seek(0)
+            assert replay.currentScore() == 0
+
+    print(f"Replayed {GAMES} recorded games")
+
+
+if __name__ == "__main__":
+    run()
@@ -13,7 +13,7 @@ import json
 import sys
 import os
 
-from hanabi_lib import start_game, end_game, Move, MoveType, Color, get_botname, get_search_thresh, set_search_thresh
+from hanabi_lib import start_game, end_game, warm_up, Move, MoveType, Color, get_botname, get_search_thresh, set_search_thresh
 
 
 sequence = []
@@ -46,6 +46,9 @@ LOG_PREFIX = "[*]"
 
 
 app = Quart(__name__)
+# load models and build belief tables now, rather than during the first move
+for botname in set(sequence if cycle else [os.getenv("BOT")]):
+    warm_up(botname)
 server, bot, thread = start_game(next_game_info())
 print(f"{LOG_PREFIX} SERVER SEED: {server.seed}")
 